@@ -11,6 +11,7 @@
 
 #include "Optional/XUSGObjLoader.h"
 #include "ComputeRaster.h"
+#include "Tracer.h"
 
 using namespace std;
 using namespace XUSG;
@@ -22,7 +23,15 @@ ComputeRaster::ComputeRaster(uint32_t width, uint32_t height, std::wstring name)
 	m_pausing(false),
 	m_tracking(false),
 	m_meshFileName("Media/bunny.obj"),
-	m_meshPosScale(0.0f, 0.0f, 0.0f, 1.0f)
+	m_meshPosScale(0.0f, 0.0f, 0.0f, 1.0f),
+	m_binThreshold(0.0f),
+	m_coarseShading(0.0f),
+	m_targetFPS(0.0f),
+	m_temporalCache(0),
+	m_traceFileName("Trace.json"),
+	m_depthPrepass(false),
+	m_occlusionCulling(false),
+	m_shadowAtlas(false)
 {
 #if defined (_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -138,6 +147,16 @@ void ComputeRaster::LoadAssets()
 	N_RETURN(m_renderer->Init(pCommandList, m_width, m_height, uploaders,
 		m_meshFileName.c_str(), m_meshPosScale), ThrowIfFailed(E_FAIL));
 
+	// A fixed bin threshold overrides the auto-tuning
+	if (m_binThreshold > 0.0f) m_renderer->SetBinThreshold(m_binThreshold);
+	else m_renderer->AutoTuneBinThreshold();
+	m_renderer->SetDepthPrepass(m_depthPrepass);
+	m_renderer->SetOcclusionCulling(m_occlusionCulling);
+	m_renderer->SetCoarseShading(m_coarseShading);
+	if (m_targetFPS > 0.0f) m_renderer->SetFrameTimeBudget(1.0 / m_targetFPS);
+	m_renderer->SetTemporalCache(m_temporalCache);
+	m_renderer->SetShadowAtlas(m_shadowAtlas);
+
 	// Close the command list and execute it to begin the initial GPU setup.
 	ThrowIfFailed(pCommandList->Close());
 	m_commandQueue->SubmitCommandList(pCommandList);
@@ -179,8 +198,9 @@ void ComputeRaster::OnUpdate()
 	// Timer
 	static auto time = 0.0, pauseTime = 0.0;
 
+	float timeStep;
 	m_timer.Tick();
-	const auto totalTime = CalculateFrameStats();
+	const auto totalTime = CalculateFrameStats(&timeStep);
 	pauseTime = m_pausing ? totalTime - time : pauseTime;
 	time = totalTime - pauseTime;
 
@@ -188,12 +208,14 @@ void ComputeRaster::OnUpdate()
 	const auto eyePt = XMLoadFloat3(&m_eyePt);
 	const auto view = XMLoadFloat4x4(&m_view);
 	const auto proj = XMLoadFloat4x4(&m_proj);
-	m_renderer->UpdateFrame(m_frameIndex, view, proj, m_eyePt, time);
+	m_renderer->UpdateFrame(view, proj, m_eyePt, time, timeStep);
 }
 
 // Render the scene.
 void ComputeRaster::OnRender()
 {
+	TRACE_SCOPE_INDEX(FRAME, L"Frame", m_frameIndex);
+
 	// Record all the commands we need to render the scene into the command list.
 	PopulateCommandList();
 
@@ -226,6 +248,14 @@ void ComputeRaster::OnKeyUp(uint8_t key)
 	case 0x70:	//case VK_F1:
 		m_showFPS = !m_showFPS;
 		break;
+	case 0x71:	//case VK_F2:
+		m_renderer->SetFrontToBack(!m_renderer->IsFrontToBack());
+		break;
+	case 0x72:	//case VK_F3:
+		// The events recorded so far are dumped when tracing stops
+		Tracer::SetEnabled(!Tracer::IsEnabled());
+		if (!Tracer::IsEnabled()) Tracer::Dump(m_traceFileName.c_str());
+		break;
 	}
 }
 
@@ -306,7 +336,50 @@ void ComputeRaster::ParseCommandLineArgs(wchar_t* argv[], int argc)
 			m_meshPosScale.y = i + 3 < argc ? static_cast<float>(_wtof(argv[i + 3])) : m_meshPosScale.y;
 			m_meshPosScale.z = i + 4 < argc ? static_cast<float>(_wtof(argv[i + 4])) : m_meshPosScale.z;
 			m_meshPosScale.w = i + 5 < argc ? static_cast<float>(_wtof(argv[i + 5])) : m_meshPosScale.w;
-			break;
+		}
+		else if (_wcsnicmp(argv[i], L"-binthreshold", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/binthreshold", wcslen(argv[i])) == 0)
+		{
+			m_binThreshold = i + 1 < argc ? static_cast<float>(_wtof(argv[i + 1])) : m_binThreshold;
+		}
+		else if (_wcsnicmp(argv[i], L"-zprepass", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/zprepass", wcslen(argv[i])) == 0)
+		{
+			m_depthPrepass = true;
+		}
+		else if (_wcsnicmp(argv[i], L"-occlusioncull", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/occlusioncull", wcslen(argv[i])) == 0)
+		{
+			m_occlusionCulling = true;
+		}
+		else if (_wcsnicmp(argv[i], L"-shadowatlas", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/shadowatlas", wcslen(argv[i])) == 0)
+		{
+			m_shadowAtlas = true;
+		}
+		else if (_wcsnicmp(argv[i], L"-coarseshading", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/coarseshading", wcslen(argv[i])) == 0)
+		{
+			m_coarseShading = i + 1 < argc ? static_cast<float>(_wtof(argv[i + 1])) : m_coarseShading;
+		}
+		else if (_wcsnicmp(argv[i], L"-targetfps", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/targetfps", wcslen(argv[i])) == 0)
+		{
+			m_targetFPS = i + 1 < argc ? static_cast<float>(_wtof(argv[i + 1])) : m_targetFPS;
+		}
+		else if (_wcsnicmp(argv[i], L"-temporalcache", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/temporalcache", wcslen(argv[i])) == 0)
+		{
+			m_temporalCache = i + 1 < argc ? static_cast<uint32_t>(_wtoi(argv[i + 1])) : m_temporalCache;
+		}
+		else if (_wcsnicmp(argv[i], L"-trace", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/trace", wcslen(argv[i])) == 0)
+		{
+			// Trace from the start, and dump the events at exit
+			if (i + 1 < argc && argv[i + 1][0] != L'-' && argv[i + 1][0] != L'/')
+				m_traceFileName = converter.to_bytes(argv[i + 1]);
+			Tracer::SetExitDumpFile(m_traceFileName.c_str());
+			Tracer::SetEnabled(true);
 		}
 	}
 }
@@ -405,6 +478,33 @@ double ComputeRaster::CalculateFrameStats(float* pTimeStep)
 		windowText << L"    fps: ";
 		if (m_showFPS) windowText << setprecision(2) << fixed << fps;
 		else windowText << L"[F1]";
+		windowText << L"    bin threshold: " << setprecision(0) << fixed << m_renderer->GetBinThreshold();
+		if (m_renderer->IsBinThresholdTuning()) windowText << L" (tuning)";
+		windowText << L"    front to back [F2]: " << (m_renderer->IsFrontToBack() ? L"on" : L"off");
+		windowText << L"    trace [F3]: " << (Tracer::IsEnabled() ? L"on" : L"off");
+		if (m_targetFPS > 0.0f) windowText << L"    resolution: " << setprecision(0) << fixed <<
+			m_renderer->GetResolutionScale() * 100.0f << L"%";
+		if (m_temporalCache > 0)
+		{
+			// The reused invocations are the pixel shading saved by the cache
+			const auto& cacheStats = m_renderer->GetTemporalCacheStats();
+			const auto numInvocations = (max)(cacheStats.Reused + cacheStats.Shaded, 1u);
+			windowText << L"    shading reused: " << setprecision(0) << fixed <<
+				cacheStats.Reused * 100.0f / numInvocations << L"%";
+		}
+		windowText << L"    transient MB: " << (m_renderer->GetTransientMemory() >> 20);
+#if EARLY_Z_STATS
+		const auto& earlyZStats = m_renderer->GetEarlyZStats();
+		windowText << L"    early-Z rejected tile prims: " << earlyZStats.TilePrims;
+		windowText << L", pixels: " << earlyZStats.Pixels;
+#endif
+#if PIPELINE_STATS
+		const auto& pipelineStats = m_renderer->GetPipelineStats();
+		windowText << L"    triangles in: " << pipelineStats.TrianglesIn;
+		windowText << L", culled: " << pipelineStats.CulledFrustum + pipelineStats.CulledScissor +
+			pipelineStats.CulledOcclusion;
+		windowText << L", pixels shaded: " << pipelineStats.PixelsShaded;
+#endif
 		SetCustomWindowText(windowText.str().c_str());
 	}
 
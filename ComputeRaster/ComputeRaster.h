@@ -77,6 +77,14 @@ private:
 	// User external settings
 	std::string m_meshFileName;
 	XMFLOAT4 m_meshPosScale;
+	float m_binThreshold;
+	float m_coarseShading;
+	float m_targetFPS;
+	uint32_t m_temporalCache;
+	std::string m_traceFileName;
+	bool m_depthPrepass;
+	bool m_occlusionCulling;
+	bool m_shadowAtlas;
 
 	void LoadPipeline();
 	void LoadAssets();
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "AutoTuner.h"
+
+using namespace std;
+
+AutoTuner::AutoTuner(const float* pCandidates, uint32_t numCandidates, float defaultValue,
+	uint32_t numWarmupFrames, uint32_t numSampleFrames) :
+	m_candidates(pCandidates, pCandidates + numCandidates),
+	m_value(defaultValue),
+	m_candidateIdx(0),
+	m_frameIdx(0),
+	m_numWarmupFrames(numWarmupFrames),
+	m_numSampleFrames((max)(numSampleFrames, 1u)),
+	m_isTuning(false)
+{
+	m_samples.reserve(m_numSampleFrames);
+	m_costs.reserve(numCandidates);
+}
+
+AutoTuner::~AutoTuner()
+{
+}
+
+void AutoTuner::Start()
+{
+	if (m_candidates.empty()) return;
+
+	m_samples.clear();
+	m_costs.clear();
+	m_candidateIdx = 0;
+	m_frameIdx = 0;
+	m_value = m_candidates[0];
+	m_isTuning = true;
+}
+
+void AutoTuner::SetFixed(float value)
+{
+	m_value = value;
+	m_isTuning = false;
+}
+
+void AutoTuner::Update(double frameCost)
+{
+	if (!m_isTuning) return;
+
+	// Skip the warm-up frames of the current candidate
+	if (m_frameIdx++ < m_numWarmupFrames) return;
+	m_samples.emplace_back(frameCost);
+	if (m_samples.size() < m_numSampleFrames) return;
+
+	// The median is robust to the occasional hitches
+	const auto median = m_samples.begin() + m_samples.size() / 2;
+	nth_element(m_samples.begin(), median, m_samples.end());
+	m_costs.emplace_back(*median);
+	m_samples.clear();
+	m_frameIdx = 0;
+
+	if (++m_candidateIdx < m_candidates.size())
+	{
+		m_value = m_candidates[m_candidateIdx];
+		return;
+	}
+
+	// All the candidates are measured
+	const auto best = min_element(m_costs.cbegin(), m_costs.cend()) - m_costs.cbegin();
+	m_value = m_candidates[best];
+	m_isTuning = false;
+}
+
+float AutoTuner::GetValue() const
+{
+	return m_value;
+}
+
+bool AutoTuner::IsTuning() const
+{
+	return m_isTuning;
+}
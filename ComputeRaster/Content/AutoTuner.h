@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+//--------------------------------------------------------------------------------------
+// Picks the cheapest of a list of candidate values for a pipeline parameter.
+// Each candidate is used for a few warm-up frames, whose costs are discarded as they
+// may still reflect the previous candidate, and then for a number of sampled frames;
+// the candidate with the lowest median cost wins. A fixed value bypasses tuning.
+//--------------------------------------------------------------------------------------
+class AutoTuner
+{
+public:
+	AutoTuner(const float* pCandidates, uint32_t numCandidates, float defaultValue,
+		uint32_t numWarmupFrames = 4, uint32_t numSampleFrames = 16);
+	virtual ~AutoTuner();
+
+	void Start();
+	void SetFixed(float value);
+	void Update(double frameCost);
+
+	float GetValue() const;
+	bool IsTuning() const;
+
+protected:
+	std::vector<float>	m_candidates;
+	std::vector<double>	m_samples;
+	std::vector<double>	m_costs;
+
+	float		m_value;
+	uint32_t	m_candidateIdx;
+	uint32_t	m_frameIdx;
+	uint32_t	m_numWarmupFrames;
+	uint32_t	m_numSampleFrames;
+	bool		m_isTuning;
+};
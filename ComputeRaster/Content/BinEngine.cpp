@@ -0,0 +1,256 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "BinEngine.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace RasterCommon;
+
+static const uint32_t g_invalidIdx = UINT32_MAX;
+
+BinEngine::BinEngine(ThreadPool& threadPool) :
+	m_threadPool(threadPool),
+	m_width(0.0f),
+	m_height(0.0f),
+	m_numBinX(0),
+	m_numBinY(0),
+	m_binSizeLog(BIN_SIZE_LOG),
+	m_largePrimThreshold(UINT32_MAX)
+{
+}
+
+BinEngine::~BinEngine()
+{
+}
+
+void BinEngine::SetViewport(float width, float height)
+{
+	const auto binSize = static_cast<float>(1 << m_binSizeLog);
+	m_width = width;
+	m_height = height;
+	m_numBinX = static_cast<uint32_t>(ceilf(width / binSize));
+	m_numBinY = static_cast<uint32_t>(ceilf(height / binSize));
+}
+
+bool BinEngine::SetBinSizeLog(uint32_t binSizeLog)
+{
+	if (binSizeLog < MinBinSizeLog || binSizeLog > MaxBinSizeLog) return false;
+
+	m_binSizeLog = binSizeLog;
+	SetViewport(m_width, m_height);
+
+	return true;
+}
+
+void BinEngine::SetLargePrimitiveThreshold(uint32_t numBins)
+{
+	m_largePrimThreshold = numBins;
+}
+
+void BinEngine::Bin(const XMFLOAT4* pVertexPos, uint32_t numTriangles)
+{
+	const auto numWorkers = m_threadPool.GetNumWorkers();
+	const auto numBins = m_numBinX * m_numBinY;
+	m_workerBins.resize(numWorkers);
+
+	// Bin the triangles into the per-worker lists
+	m_threadPool.Execute([&](uint32_t workerIdx) { binTriangles(workerIdx, pVertexPos, numTriangles); });
+
+	// Compute the offset of each bin in the concatenated list
+	auto offset = 0u;
+	m_binOffsets.resize(numBins + 1);
+	for (auto i = 0u; i < numBins; ++i)
+	{
+		m_binOffsets[i] = offset;
+		for (const auto& bins : m_workerBins) offset += bins.Counts[i];
+	}
+	m_binOffsets[numBins] = offset;
+	m_binPrimitives.resize(offset);
+	m_binLargeCounts.resize(numBins);
+
+	// Concatenate the per-worker lists
+	m_threadPool.Execute([this](uint32_t workerIdx) { concatenate(workerIdx); });
+}
+
+const uint32_t* BinEngine::GetBinPrimitives(uint32_t binIdx, uint32_t& numPrims) const
+{
+	numPrims = m_binOffsets[binIdx + 1] - m_binOffsets[binIdx];
+
+	return m_binPrimitives.data() + m_binOffsets[binIdx];
+}
+
+uint32_t BinEngine::GetNumBinX() const
+{
+	return m_numBinX;
+}
+
+uint32_t BinEngine::GetNumBinY() const
+{
+	return m_numBinY;
+}
+
+uint32_t BinEngine::GetBinSizeLog() const
+{
+	return m_binSizeLog;
+}
+
+uint32_t BinEngine::GetNumBinPrimitives() const
+{
+	return static_cast<uint32_t>(m_binPrimitives.size());
+}
+
+uint32_t BinEngine::GetNumLargePrimitives(uint32_t binIdx) const
+{
+	return m_binLargeCounts[binIdx];
+}
+
+void BinEngine::binTriangles(uint32_t workerIdx, const XMFLOAT4* pVertexPos, uint32_t numTriangles)
+{
+	const auto numWorkers = m_threadPool.GetNumWorkers();
+	const auto numBins = m_numBinX * m_numBinY;
+
+	// Reset the lists of this worker, keeping the chunk capacity for the later frames
+	auto& bins = m_workerBins[workerIdx];
+	bins.Chunks.clear();
+	bins.Heads.assign(numBins, g_invalidIdx);
+	bins.Tails.assign(numBins, g_invalidIdx);
+	bins.Counts.assign(numBins, 0);
+	bins.LargeCounts.assign(numBins, 0);
+
+	// Contiguous triangle ranges keep the order deterministic after concatenation
+	const auto start = static_cast<uint32_t>(static_cast<uint64_t>(numTriangles) * workerIdx / numWorkers);
+	const auto end = static_cast<uint32_t>(static_cast<uint64_t>(numTriangles) * (workerIdx + 1) / numWorkers);
+	switch (m_binSizeLog)
+	{
+	case 4:
+		for (auto i = start; i < end; ++i) binTriangle<4>(bins, pVertexPos, i);
+		break;
+	case 5:
+		for (auto i = start; i < end; ++i) binTriangle<5>(bins, pVertexPos, i);
+		break;
+	case 6:
+		for (auto i = start; i < end; ++i) binTriangle<6>(bins, pVertexPos, i);
+		break;
+	case 7:
+		for (auto i = start; i < end; ++i) binTriangle<7>(bins, pVertexPos, i);
+		break;
+	default:
+		assert(!"Unsupported bin size");
+	}
+}
+
+template<uint32_t BinSizeLog>
+void BinEngine::binTriangle(WorkerBins& bins, const XMFLOAT4* pVertexPos, uint32_t primId)
+{
+	static const float binSize = static_cast<float>(1 << BinSizeLog);
+
+	XMFLOAT4 primVPos[3];
+
+	// Load the vertex positions of the triangle
+	const auto baseVIdx = primId * 3;
+	for (uint8_t i = 0; i < 3; ++i) primVPos[i] = pVertexPos[baseVIdx + i];
+
+	// Cull the primitive.
+	if (CullPrimitive(primVPos)) return;
+
+	// To screen space.
+	ToScreenSpace(primVPos, m_width, m_height);
+
+	// Back faces and degenerate primitives are rejected by the pixel raster anyway.
+	const XMFLOAT2 p[] =
+	{
+		XMFLOAT2(primVPos[0].x, primVPos[0].y),
+		XMFLOAT2(primVPos[1].x, primVPos[1].y),
+		XMFLOAT2(primVPos[2].x, primVPos[2].y)
+	};
+	if (!(Determinant(p[0], p[1], p[2]) > 0.0f)) return;
+
+	// Create the AABB, clamped to the viewport before the integer conversion.
+	const auto minX = (max)((min)(p[0].x, (min)(p[1].x, p[2].x)), 0.0f);
+	const auto minY = (max)((min)(p[0].y, (min)(p[1].y, p[2].y)), 0.0f);
+	const auto maxX = (min)((max)(p[0].x, (max)(p[1].x, p[2].x)), m_width);
+	const auto maxY = (min)((max)(p[0].y, (max)(p[1].y, p[2].y)), m_height);
+	if (minX > maxX || minY > maxY) return;
+
+	const auto minBinX = (min)(static_cast<uint32_t>(minX) >> BinSizeLog, m_numBinX - 1);
+	const auto minBinY = (min)(static_cast<uint32_t>(minY) >> BinSizeLog, m_numBinY - 1);
+	const auto maxBinX = (min)(static_cast<uint32_t>(maxX) >> BinSizeLog, m_numBinX - 1);
+	const auto maxBinY = (min)(static_cast<uint32_t>(maxY) >> BinSizeLog, m_numBinY - 1);
+
+	// A primitive inside a single bin needs no overlap tests.
+	if (minBinX == maxBinX && minBinY == maxBinY)
+	{
+		appendPrimitive(bins, m_numBinX * minBinY + minBinX, primId, false);
+		return;
+	}
+
+	// Count against the AABB, as the exact coverage is only known after the tests below
+	const auto isLarge = (maxBinX - minBinX + 1) * (maxBinY - minBinY + 1) > m_largePrimThreshold;
+
+	// Scale the primitive for conservative rasterization.
+	XMFLOAT2 v[3], sv[3];
+	for (uint8_t i = 0; i < 3; ++i) v[i] = XMFLOAT2(p[i].x / binSize, p[i].y / binSize);
+	Scale(sv, v, 0.5f);
+
+	// Nearly parallel edges may push the scaled vertices to infinity;
+	// fall back to the AABB to stay conservative.
+	auto isFinite = true;
+	for (const auto& vert : sv) isFinite = isFinite && isfinite(vert.x) && isfinite(vert.y);
+
+	EdgeFunctions edges;
+	SetupEdgeFunctions(edges, sv);
+
+	for (auto i = minBinY; i <= maxBinY; ++i)
+		for (auto j = minBinX; j <= maxBinX; ++j)
+			if (!isFinite || Overlap(j + 0.5f, i + 0.5f, edges))
+				appendPrimitive(bins, m_numBinX * i + j, primId, isLarge);
+}
+
+void BinEngine::appendPrimitive(WorkerBins& bins, uint32_t binIdx, uint32_t primId, bool isLarge)
+{
+	auto tail = bins.Tails[binIdx];
+	if (tail == g_invalidIdx || bins.Chunks[tail].Count >= ChunkSize)
+	{
+		// Link a new chunk to the bin
+		const auto chunkIdx = static_cast<uint32_t>(bins.Chunks.size());
+		bins.Chunks.emplace_back();
+		bins.Chunks.back().Next = g_invalidIdx;
+		bins.Chunks.back().Count = 0;
+
+		if (tail == g_invalidIdx) bins.Heads[binIdx] = chunkIdx;
+		else bins.Chunks[tail].Next = chunkIdx;
+		bins.Tails[binIdx] = tail = chunkIdx;
+	}
+
+	auto& chunk = bins.Chunks[tail];
+	chunk.PrimIds[chunk.Count++] = primId;
+	++bins.Counts[binIdx];
+	if (isLarge) ++bins.LargeCounts[binIdx];
+}
+
+void BinEngine::concatenate(uint32_t workerIdx)
+{
+	const auto numWorkers = m_threadPool.GetNumWorkers();
+	const auto numBins = m_numBinX * m_numBinY;
+
+	// Each worker gathers a disjoint range of bins
+	const auto start = numBins * workerIdx / numWorkers;
+	const auto end = numBins * (workerIdx + 1) / numWorkers;
+	for (auto i = start; i < end; ++i)
+	{
+		auto pDst = m_binPrimitives.data() + m_binOffsets[i];
+		m_binLargeCounts[i] = 0;
+		for (const auto& bins : m_workerBins)
+		{
+			m_binLargeCounts[i] += bins.LargeCounts[i];
+			for (auto j = bins.Heads[i]; j != g_invalidIdx; j = bins.Chunks[j].Next)
+			{
+				const auto& chunk = bins.Chunks[j];
+				memcpy(pDst, chunk.PrimIds, sizeof(uint32_t) * chunk.Count);
+				pDst += chunk.Count;
+			}
+		}
+	}
+}
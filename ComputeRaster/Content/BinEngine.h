@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "ThreadPool.h"
+#include "RasterCommon.h"
+
+//--------------------------------------------------------------------------------------
+// CPU bin stage. Every worker bins a contiguous range of triangles into its own
+// chunked per-bin lists, so no atomics are involved; the lists are concatenated per
+// bin in worker order at the end of the pass, which keeps the triangle order within
+// each bin deterministic. Primitives overlapping more bins than the large-primitive
+// threshold are also counted per bin, so the pixel stage can split the heavy bins.
+//--------------------------------------------------------------------------------------
+class BinEngine
+{
+public:
+	BinEngine(ThreadPool& threadPool);
+	virtual ~BinEngine();
+
+	void SetViewport(float width, float height);
+	void SetLargePrimitiveThreshold(uint32_t numBins);
+	bool SetBinSizeLog(uint32_t binSizeLog);
+	void Bin(const DirectX::XMFLOAT4* pVertexPos, uint32_t numTriangles);
+
+	const uint32_t* GetBinPrimitives(uint32_t binIdx, uint32_t& numPrims) const;
+	uint32_t GetNumBinX() const;
+	uint32_t GetNumBinY() const;
+	uint32_t GetBinSizeLog() const;
+	uint32_t GetNumBinPrimitives() const;
+	uint32_t GetNumLargePrimitives(uint32_t binIdx) const;
+
+	static const uint32_t ChunkSize = 62;
+
+	// Supported bin sizes, from 16x16 to 128x128 pixels
+	static const uint32_t MinBinSizeLog = 4;
+	static const uint32_t MaxBinSizeLog = 7;
+
+protected:
+	struct Chunk
+	{
+		uint32_t Next;
+		uint32_t Count;
+		uint32_t PrimIds[ChunkSize];
+	};
+
+	struct WorkerBins
+	{
+		std::vector<Chunk>		Chunks;
+		std::vector<uint32_t>	Heads;
+		std::vector<uint32_t>	Tails;
+		std::vector<uint32_t>	Counts;
+		std::vector<uint32_t>	LargeCounts;
+	};
+
+	void binTriangles(uint32_t workerIdx, const DirectX::XMFLOAT4* pVertexPos, uint32_t numTriangles);
+	template<uint32_t BinSizeLog>
+	void binTriangle(WorkerBins& bins, const DirectX::XMFLOAT4* pVertexPos, uint32_t primId);
+	void appendPrimitive(WorkerBins& bins, uint32_t binIdx, uint32_t primId, bool isLarge);
+	void concatenate(uint32_t workerIdx);
+
+	ThreadPool&	m_threadPool;
+
+	std::vector<WorkerBins>	m_workerBins;
+	std::vector<uint32_t>	m_binOffsets;
+	std::vector<uint32_t>	m_binPrimitives;
+	std::vector<uint32_t>	m_binLargeCounts;
+
+	float		m_width;
+	float		m_height;
+	uint32_t	m_numBinX;
+	uint32_t	m_numBinY;
+	uint32_t	m_binSizeLog;
+	uint32_t	m_largePrimThreshold;
+};
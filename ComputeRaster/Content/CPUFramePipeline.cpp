@@ -0,0 +1,182 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CPUFramePipeline.h"
+#include "Tracer.h"
+
+using namespace std;
+using namespace DirectX;
+
+static_assert(CPUFramePipeline::FrameCount >= 2, "The stages overlap over 2 frame slots at least");
+
+static uint32_t getNumFrontWorkers(uint32_t numFrontWorkers)
+{
+	return numFrontWorkers > 0 ? numFrontWorkers : (max)(thread::hardware_concurrency() / 4, 1u);
+}
+
+static uint32_t getNumPixelWorkers(uint32_t numFrontWorkers, uint32_t numPixelWorkers)
+{
+	const auto numThreads = thread::hardware_concurrency();
+	const auto numFront = getNumFrontWorkers(numFrontWorkers);
+
+	return numPixelWorkers > 0 ? numPixelWorkers : (numThreads > numFront ? numThreads - numFront : 1);
+}
+
+CPUFramePipeline::CPUFramePipeline(uint32_t numFrontWorkers, uint32_t numPixelWorkers) :
+	m_frontPool(getNumFrontWorkers(numFrontWorkers)),
+	m_rasterizer(getNumPixelWorkers(numFrontWorkers, numPixelWorkers)),
+	m_numSubmitted(0),
+	m_numFrontEnded(0),
+	m_numCompleted(0),
+	m_isExiting(false),
+	m_stageTimes()
+{
+	// The bin engines of the slots share the pool of the front end, and follow the
+	// settings of the rasterizer
+	for (auto& slot : m_slots)
+	{
+		slot.Desc = {};
+		slot.Bins = make_unique<BinEngine>(m_frontPool);
+		slot.Bins->SetBinSizeLog(m_rasterizer.GetTileSizeLog() + m_rasterizer.GetTileToBinLog());
+		slot.NumTriangles = 0;
+		slot.VertexTime = 0.0;
+		slot.BinTime = 0.0;
+	}
+	SetSplitThreshold(16);
+
+	m_frontThread = thread(&CPUFramePipeline::frontEndLoop, this);
+}
+
+CPUFramePipeline::~CPUFramePipeline()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isExiting = true;
+	}
+	m_submitCondition.notify_one();
+
+	m_frontThread.join();
+}
+
+void CPUFramePipeline::SetViewport(float width, float height)
+{
+	assert(m_numCompleted == m_numSubmitted);
+	m_rasterizer.SetViewport(width, height);
+	for (auto& slot : m_slots) slot.Bins->SetViewport(width, height);
+}
+
+void CPUFramePipeline::SetSplitThreshold(uint32_t numBins)
+{
+	assert(m_numCompleted == m_numSubmitted);
+	m_rasterizer.SetSplitThreshold(numBins);
+	for (auto& slot : m_slots) slot.Bins->SetLargePrimitiveThreshold(numBins);
+}
+
+bool CPUFramePipeline::SetTileSize(uint32_t tileSizeLog, uint32_t tileToBinLog)
+{
+	assert(m_numCompleted == m_numSubmitted);
+	if (!m_rasterizer.SetTileSize(tileSizeLog, tileToBinLog)) return false;
+	for (auto& slot : m_slots) slot.Bins->SetBinSizeLog(tileSizeLog + tileToBinLog);
+
+	return true;
+}
+
+void CPUFramePipeline::Submit(const Frame& frame)
+{
+	// The slot was released by the pixel stage of the frame FrameCount frames before,
+	// which completed within a previous Submit()
+	const auto frameIdx = m_numSubmitted;
+	m_slots[frameIdx % FrameCount].Desc = frame;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		++m_numSubmitted;
+	}
+	m_submitCondition.notify_one();
+
+	// The pixel stage of the previous frame overlaps the front end of this frame
+	if (frameIdx > m_numCompleted) rasterize(frameIdx - 1);
+}
+
+void CPUFramePipeline::Flush()
+{
+	while (m_numCompleted < m_numSubmitted) rasterize(m_numCompleted);
+}
+
+const CPURasterizer& CPUFramePipeline::GetRasterizer() const
+{
+	return m_rasterizer;
+}
+
+uint64_t CPUFramePipeline::GetNumCompletedFrames() const
+{
+	return m_numCompleted;
+}
+
+const CPURasterizer::StageTimes& CPUFramePipeline::GetStageTimes() const
+{
+	return m_stageTimes;
+}
+
+void CPUFramePipeline::frontEndLoop()
+{
+	while (true)
+	{
+		uint64_t frameIdx;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_submitCondition.wait(lock, [this]() { return m_isExiting || m_numFrontEnded < m_numSubmitted; });
+			if (m_isExiting) return;
+
+			frameIdx = m_numFrontEnded;
+		}
+
+		// Vertex and bin stages, this thread being worker 0 of the front-end pool
+		TRACE_SCOPE_INDEX(FRAME, L"FrontEnd", static_cast<uint32_t>(frameIdx));
+		auto& slot = m_slots[frameIdx % FrameCount];
+		const auto start = chrono::steady_clock::now();
+		{
+			TRACE_SCOPE(STAGE, L"Vertex");
+			slot.NumTriangles = slot.Desc.VS ? slot.Desc.VS(slot.VertexPos) : 0;
+			assert(slot.VertexPos.size() >= slot.NumTriangles * 3);
+		}
+		const auto vertexEnd = chrono::steady_clock::now();
+		{
+			TRACE_SCOPE(STAGE, L"Bin");
+			slot.Bins->Bin(slot.VertexPos.data(), slot.NumTriangles);
+		}
+		slot.VertexTime = chrono::duration<double>(vertexEnd - start).count();
+		slot.BinTime = chrono::duration<double>(chrono::steady_clock::now() - vertexEnd).count();
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			++m_numFrontEnded;
+		}
+		m_frontEndCondition.notify_one();
+	}
+}
+
+void CPUFramePipeline::waitFrontEnd(uint64_t frameIdx)
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_frontEndCondition.wait(lock, [this, frameIdx]() { return m_numFrontEnded > frameIdx; });
+}
+
+void CPUFramePipeline::rasterize(uint64_t frameIdx)
+{
+	assert(frameIdx == m_numCompleted);
+	waitFrontEnd(frameIdx);
+	TRACE_SCOPE_INDEX(FRAME, L"PixelStage", static_cast<uint32_t>(frameIdx));
+
+	// Pixel stage, the calling thread being worker 0 of the pool of the rasterizer
+	const auto& slot = m_slots[frameIdx % FrameCount];
+	m_rasterizer.SetRenderTargets(slot.Desc.pColorTarget, slot.Desc.pDepth);
+	m_rasterizer.SetPixelShader(slot.Desc.PS);
+	m_rasterizer.Rasterize(*slot.Bins, slot.VertexPos.data());
+
+	// The front end of the frame completed in waitFrontEnd()
+	m_stageTimes = m_rasterizer.GetStageTimes();
+	m_stageTimes.Vertex = slot.VertexTime;
+	m_stageTimes.Bin = slot.BinTime;
+	++m_numCompleted;
+}
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPURasterizer.h"
+
+//--------------------------------------------------------------------------------------
+// Pipelined CPU executor of the frames. The front end, the vertex and the bin stages,
+// runs on a thread and a pool of its own, so the front end of frame N + 1 overlaps the
+// pixel stage of frame N, which runs on the pool of the rasterizer driven by the thread
+// calling Submit(). The vertex positions and the bin lists of each frame live in the
+// slot of its index modulo FrameCount, so neither stage waits for the other to release
+// them, and the frames render exactly as they would with CPURasterizer::Draw().
+//--------------------------------------------------------------------------------------
+class CPUFramePipeline
+{
+public:
+	// Writes the clip-space positions of the frame, 3 per triangle, and returns the
+	// number of triangles. It runs on the front-end thread concurrently with the pixel
+	// stage of the previous frame, so it must not write what the pixel shaders read.
+	using VertexStage = std::function<uint32_t(std::vector<DirectX::XMFLOAT4>& vertexPos)>;
+
+	struct Frame
+	{
+		VertexStage					VS;
+		CPURasterizer::PixelShader	PS;
+		TiledSurface*				pColorTarget;
+		TiledSurface*				pDepth;
+	};
+
+	// The workers are split between the front end and the pixel stage, 1/4 of the
+	// hardware threads to the front end by default
+	CPUFramePipeline(uint32_t numFrontWorkers = 0, uint32_t numPixelWorkers = 0);
+	virtual ~CPUFramePipeline();
+
+	// The settings apply to the frames submitted after Flush()
+	void SetViewport(float width, float height);
+	void SetSplitThreshold(uint32_t numBins);
+	bool SetTileSize(uint32_t tileSizeLog, uint32_t tileToBinLog);
+
+	// Starts the front end of the frame, then runs the pixel stage of the previous frame,
+	// so the frame is complete after the next Submit() or Flush().
+	void Submit(const Frame& frame);
+	// Completes all submitted frames
+	void Flush();
+
+	const CPURasterizer& GetRasterizer() const;
+	uint64_t GetNumCompletedFrames() const;
+	// Of the last completed frame
+	const CPURasterizer::StageTimes& GetStageTimes() const;
+
+	static const uint32_t FrameCount = FRAME_COUNT;
+
+protected:
+	struct Slot
+	{
+		Frame					Desc;
+		std::vector<DirectX::XMFLOAT4> VertexPos;
+		std::unique_ptr<BinEngine> Bins;
+		uint32_t				NumTriangles;
+		double					VertexTime;
+		double					BinTime;
+	};
+
+	void frontEndLoop();
+	void waitFrontEnd(uint64_t frameIdx);
+	void rasterize(uint64_t frameIdx);
+
+	ThreadPool		m_frontPool;
+	CPURasterizer	m_rasterizer;
+	Slot			m_slots[FrameCount];
+
+	std::thread				m_frontThread;
+	std::mutex				m_mutex;
+	std::condition_variable	m_submitCondition;
+	std::condition_variable	m_frontEndCondition;
+
+	uint64_t	m_numSubmitted;
+	uint64_t	m_numFrontEnded;
+	uint64_t	m_numCompleted;
+	bool		m_isExiting;
+
+	CPURasterizer::StageTimes m_stageTimes;
+};
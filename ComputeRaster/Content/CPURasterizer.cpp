@@ -0,0 +1,349 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cfloat>
+#include "CPURasterizer.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace RasterCommon;
+
+CPURasterizer::CPURasterizer(uint32_t numWorkers) :
+	m_threadPool(numWorkers),
+	m_binEngine(m_threadPool),
+	m_scheduler(m_threadPool),
+	m_pBins(nullptr),
+	m_pColorTarget(nullptr),
+	m_pDepth(nullptr),
+	m_pVertexPos(nullptr),
+	m_width(0.0f),
+	m_height(0.0f),
+	m_tileSizeLog(TILE_SIZE_LOG),
+	m_tileToBinLog(TILE_TO_BIN_LOG),
+	m_stageTimes()
+{
+	// Split the bins of triangles larger than 4x4 bins by default
+	SetSplitThreshold(16);
+}
+
+CPURasterizer::~CPURasterizer()
+{
+}
+
+void CPURasterizer::SetRenderTargets(TiledSurface* pColorTarget, TiledSurface* pDepth)
+{
+	m_pColorTarget = pColorTarget;
+	m_pDepth = pDepth;
+}
+
+void CPURasterizer::SetViewport(float width, float height)
+{
+	m_width = width;
+	m_height = height;
+	m_binEngine.SetViewport(width, height);
+}
+
+void CPURasterizer::SetPixelShader(const PixelShader& pixelShader)
+{
+	m_pixelShader = pixelShader;
+}
+
+void CPURasterizer::SetSplitThreshold(uint32_t numBins)
+{
+	m_binEngine.SetLargePrimitiveThreshold(numBins);
+}
+
+bool CPURasterizer::SetTileSize(uint32_t tileSizeLog, uint32_t tileToBinLog)
+{
+	if (tileSizeLog < MinTileSizeLog || tileSizeLog > MaxTileSizeLog) return false;
+	if (tileToBinLog < MinTileToBinLog || tileToBinLog > MaxTileToBinLog) return false;
+	if (!m_binEngine.SetBinSizeLog(tileSizeLog + tileToBinLog)) return false;
+
+	m_tileSizeLog = tileSizeLog;
+	m_tileToBinLog = tileToBinLog;
+
+	return true;
+}
+
+void CPURasterizer::Draw(const XMFLOAT4* pVertexPos, uint32_t numTriangles)
+{
+	rasterize(m_binEngine, pVertexPos, numTriangles);
+}
+
+void CPURasterizer::Rasterize(const BinEngine& binEngine, const XMFLOAT4* pVertexPos)
+{
+	assert(binEngine.GetBinSizeLog() == m_tileSizeLog + m_tileToBinLog);
+	rasterize(binEngine, pVertexPos, 0);
+}
+
+const BinEngine& CPURasterizer::GetBinEngine() const
+{
+	return m_binEngine;
+}
+
+const TileScheduler& CPURasterizer::GetScheduler() const
+{
+	return m_scheduler;
+}
+
+const CPURasterizer::StageTimes& CPURasterizer::GetStageTimes() const
+{
+	return m_stageTimes;
+}
+
+uint32_t CPURasterizer::GetNumJobs() const
+{
+	return static_cast<uint32_t>(m_jobs.size());
+}
+
+uint32_t CPURasterizer::GetTileSizeLog() const
+{
+	return m_tileSizeLog;
+}
+
+uint32_t CPURasterizer::GetTileToBinLog() const
+{
+	return m_tileToBinLog;
+}
+
+void CPURasterizer::rasterize(const BinEngine& binEngine, const XMFLOAT4* pVertexPos, uint32_t numTriangles)
+{
+	m_pBins = &binEngine;
+	m_pVertexPos = pVertexPos;
+	m_stageTimes = {};
+
+	// Each stage depends on the previous one, so each is a level of a single pass, which
+	// spreads across the pool by itself. Bins filled elsewhere skip the bin stage.
+	auto& graph = m_stageGraph;
+	graph.Reset();
+	const auto bins = graph.ImportResource();
+	const auto jobs = graph.ImportResource();
+	const auto targets = graph.ImportResource();
+	if (&binEngine == &m_binEngine)
+	{
+		const auto bin = graph.AddPass(L"Bin", [this, numTriangles](XUSG::CommandList*)
+		{
+			const auto start = chrono::steady_clock::now();
+			m_binEngine.Bin(m_pVertexPos, numTriangles);
+			m_stageTimes.Bin = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		});
+		graph.Write(bin, bins);
+	}
+
+	const auto tile = graph.AddPass(L"Tile", [this](XUSG::CommandList*)
+	{
+		const auto start = chrono::steady_clock::now();
+		generateJobs();
+		m_stageTimes.Tile = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	});
+	graph.Read(tile, bins);
+	graph.Write(tile, jobs);
+
+	// The scheduler balances the uneven jobs across the workers
+	const auto pixel = graph.AddPass(L"Pixel", [this](XUSG::CommandList*)
+	{
+		m_scheduler.Run(static_cast<uint32_t>(m_jobs.size()),
+			[this](uint32_t, uint32_t jobIdx) { rasterizeJob(m_jobs[jobIdx]); });
+		m_stageTimes.Pixel = m_scheduler.GetElapsedTime();
+	});
+	graph.Read(pixel, bins);
+	graph.Read(pixel, jobs);
+	graph.Write(pixel, targets);
+
+	graph.Compile();
+	graph.Execute(m_threadPool);
+}
+
+void CPURasterizer::generateJobs()
+{
+	const auto numBinX = m_pBins->GetNumBinX();
+	const auto numBinY = m_pBins->GetNumBinY();
+	const auto width = static_cast<uint32_t>(ceilf(m_width));
+	const auto height = static_cast<uint32_t>(ceilf(m_height));
+	const auto binSizeLog = m_tileSizeLog + m_tileToBinLog;
+
+	m_jobs.clear();
+	for (auto i = 0u; i < numBinY; ++i)
+	{
+		for (auto j = 0u; j < numBinX; ++j)
+		{
+			const auto binIdx = numBinX * i + j;
+			uint32_t numPrims;
+			m_pBins->GetBinPrimitives(binIdx, numPrims);
+			if (numPrims == 0) continue;
+
+			// Sub-bin jobs stay adjacent, so that stealing keeps the locality. They cover whole
+			// tiles of the surfaces, whose clear flags the concurrent jobs would otherwise share.
+			const auto maxSplitLog = (min)(m_tileToBinLog, binSizeLog - TILE_SIZE_LOG);
+			const auto splitLog = m_pBins->GetNumLargePrimitives(binIdx) > 0 ? (min)(SplitLog, maxSplitLog) : 0;
+			const auto regionSize = 1u << (binSizeLog - splitLog);
+			for (auto y = i << binSizeLog; y < (i + 1) << binSizeLog && y < height; y += regionSize)
+			{
+				for (auto x = j << binSizeLog; x < (j + 1) << binSizeLog && x < width; x += regionSize)
+				{
+					Job job;
+					job.BinIdx = binIdx;
+					job.Left = x;
+					job.Top = y;
+					job.Right = (min)(x + regionSize, width);
+					job.Bottom = (min)(y + regionSize, height);
+					m_jobs.emplace_back(job);
+				}
+			}
+		}
+	}
+}
+
+void CPURasterizer::rasterizeJob(const Job& job)
+{
+	switch (m_tileSizeLog)
+	{
+	case 2:
+		rasterizeJob<2>(job);
+		break;
+	case 3:
+		rasterizeJob<3>(job);
+		break;
+	case 4:
+		rasterizeJob<4>(job);
+		break;
+	default:
+		assert(!"Unsupported tile size");
+	}
+}
+
+template<uint32_t TileSizeLog>
+void CPURasterizer::rasterizeJob(const Job& job)
+{
+	// Primitives arrive in submission order, so the depth ties resolve like the GPU path
+	uint32_t numPrims;
+	const auto pPrimIds = m_pBins->GetBinPrimitives(job.BinIdx, numPrims);
+	for (auto i = 0u; i < numPrims; ++i) rasterizeTriangle<TileSizeLog>(pPrimIds[i], job);
+}
+
+template<uint32_t TileSizeLog>
+void CPURasterizer::rasterizeTriangle(uint32_t primId, const Job& job)
+{
+	static const int32_t tileSize = 1 << TileSizeLog;
+
+	XMFLOAT4 primVPos[3];
+
+	// Load the vertex positions of the triangle
+	const auto baseVIdx = primId * 3;
+	for (uint8_t i = 0; i < 3; ++i) primVPos[i] = m_pVertexPos[baseVIdx + i];
+
+	// To screen space.
+	ToScreenSpace(primVPos, m_width, m_height);
+
+	const XMFLOAT2 v[] =
+	{
+		XMFLOAT2(primVPos[0].x, primVPos[0].y),
+		XMFLOAT2(primVPos[1].x, primVPos[1].y),
+		XMFLOAT2(primVPos[2].x, primVPos[2].y)
+	};
+	const auto area = Determinant(v[0], v[1], v[2]);
+	if (!(area > 0.0f)) return;
+
+	EdgeFunctions edges;
+	SetupEdgeFunctions(edges, v);
+
+	// Pixel centers inside the AABB of the primitive, clipped to the job region
+	const auto minX = (max)((min)(v[0].x, (min)(v[1].x, v[2].x)), static_cast<float>(job.Left));
+	const auto minY = (max)((min)(v[0].y, (min)(v[1].y, v[2].y)), static_cast<float>(job.Top));
+	const auto maxX = (min)((max)(v[0].x, (max)(v[1].x, v[2].x)), (min)(static_cast<float>(job.Right), m_width));
+	const auto maxY = (min)((max)(v[0].y, (max)(v[1].y, v[2].y)), (min)(static_cast<float>(job.Bottom), m_height));
+	if (!(minX < maxX && minY < maxY)) return;
+
+	const auto x0 = static_cast<int32_t>(ceilf(minX - 0.5f));
+	const auto y0 = static_cast<int32_t>(ceilf(minY - 0.5f));
+	const auto x1 = static_cast<int32_t>(floorf(maxX - 0.5f));
+	const auto y1 = static_cast<int32_t>(floorf(maxY - 0.5f));
+	if (x0 > x1 || y0 > y1) return;
+
+	for (auto ty = y0 >> TileSizeLog; ty <= y1 >> TileSizeLog; ++ty)
+	{
+		for (auto tx = x0 >> TileSizeLog; tx <= x1 >> TileSizeLog; ++tx)
+		{
+			const auto tileX0 = (max)(x0, tx << TileSizeLog);
+			const auto tileY0 = (max)(y0, ty << TileSizeLog);
+			const auto tileX1 = (min)(x1, (tx << TileSizeLog) + tileSize - 1);
+			const auto tileY1 = (min)(y1, (ty << TileSizeLog) + tileSize - 1);
+
+			// Test the extreme pixel centers of the tile against the edges, with a margin
+			// for the rounding, so that the per-pixel tests give the same coverage.
+			const auto dispX0 = tileX0 + 0.5f - edges.MinPt.x;
+			const auto dispY0 = tileY0 + 0.5f - edges.MinPt.y;
+			const auto dispX1 = tileX1 + 0.5f - edges.MinPt.x;
+			const auto dispY1 = tileY1 + 0.5f - edges.MinPt.y;
+			auto isInside = true;
+			auto isOutside = false;
+			for (uint8_t i = 0; i < 3; ++i)
+			{
+				const auto& n = edges.N[i];
+				const auto wMin = edges.W[i] + n.x * (n.x < 0.0f ? dispX1 : dispX0) + n.y * (n.y < 0.0f ? dispY1 : dispY0);
+				const auto wMax = edges.W[i] + n.x * (n.x < 0.0f ? dispX0 : dispX1) + n.y * (n.y < 0.0f ? dispY0 : dispY1);
+				const auto margin = 16.0f * FLT_EPSILON * (fabsf(edges.W[i]) +
+					fabsf(n.x) * (max)(fabsf(dispX0), fabsf(dispX1)) + fabsf(n.y) * (max)(fabsf(dispY0), fabsf(dispY1)));
+				isInside = isInside && wMin > margin;
+				isOutside = isOutside || wMax < -margin;
+			}
+			if (isOutside) continue;
+
+			// Materialize the pending fast clears of the surface tiles
+			for (auto i = tileY0 >> TILE_SIZE_LOG; i <= tileY1 >> TILE_SIZE_LOG; ++i)
+			{
+				for (auto j = tileX0 >> TILE_SIZE_LOG; j <= tileX1 >> TILE_SIZE_LOG; ++j)
+				{
+					if (m_pDepth) m_pDepth->TouchTile(j, i);
+					if (m_pColorTarget) m_pColorTarget->TouchTile(j, i);
+				}
+			}
+
+			for (auto y = tileY0; y <= tileY1; ++y)
+			{
+				for (auto x = tileX0; x <= tileX1; ++x)
+				{
+					PixelInput input;
+					input.Pos.x = x + 0.5f;
+					input.Pos.y = y + 0.5f;
+
+					float w[3];
+					ComputeUnnormalizedBarycentric(w, input.Pos.x, input.Pos.y, edges);
+					if (!isInside && (w[0] < 0.0f || w[1] < 0.0f || w[2] < 0.0f)) continue;
+
+					// Normalize barycentric coordinates.
+					for (auto& wi : w) wi /= area;
+
+					// Depth test
+					input.Pos.z = w[0] * primVPos[0].z + w[1] * primVPos[1].z + w[2] * primVPos[2].z;
+					if (m_pDepth)
+					{
+						uint32_t depth;
+						memcpy(&depth, &input.Pos.z, sizeof(uint32_t));
+
+						auto& depthMin = *m_pDepth->GetTexel(x, y);
+						if (depth > depthMin) continue;
+						depthMin = depth;
+					}
+
+					if (!m_pColorTarget || !m_pixelShader) continue;
+
+					// Interpolations
+					auto perspSum = 0.0f;
+					for (uint8_t i = 0; i < 3; ++i)
+					{
+						input.Persp[i] = w[i] * primVPos[i].w;
+						perspSum += input.Persp[i];
+					}
+					input.Pos.w = 1.0f / perspSum;
+					for (auto& persp : input.Persp) persp *= input.Pos.w;
+					input.PrimId = primId;
+
+					// Call pixel shader
+					*m_pColorTarget->GetTexel(x, y) = m_pixelShader(input);
+				}
+			}
+		}
+	}
+}
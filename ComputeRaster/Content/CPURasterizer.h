@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "BinEngine.h"
+#include "FrameGraph.h"
+#include "TileScheduler.h"
+#include "TiledSurface.h"
+
+//--------------------------------------------------------------------------------------
+// CPU backend of the raster pipeline. Triangles in clip space are binned by the
+// BinEngine, and each non-empty bin is rasterized as a job of the work-stealing scheduler.
+// A region is only ever touched by the worker running its job, so the depth test and
+// the target writes need no atomics or mutexes, unlike PixelRaster.hlsl.
+// Bins overlapped by large triangles are split into finer sub-bin jobs, so that a
+// triangle close to the camera cannot stall one worker for most of the frame.
+// Tile and bin sizes are runtime options; the raster kernels are instantiated per
+// supported tile size, so the inner loops still see compile-time constants.
+// The bin, tile and pixel stages are the passes of a graph executed on the pool.
+//--------------------------------------------------------------------------------------
+class CPURasterizer
+{
+public:
+	struct PixelInput
+	{
+		DirectX::XMFLOAT4 Pos;		// Screen-space x, y, depth, and w
+		float		Persp[3];		// Perspective-correct barycentric coordinates
+		uint32_t	PrimId;
+	};
+
+	// Returns the color of the pixel in R8G8B8A8
+	using PixelShader = std::function<uint32_t(const PixelInput& input)>;
+
+	// Wall-clock times of the stages of the last draw, in seconds
+	struct StageTimes
+	{
+		double Vertex;	// Only measured by CPUFramePipeline
+		double Bin;		// 0 if binned elsewhere, see Rasterize()
+		double Tile;	// Generation of the jobs from the bins
+		double Pixel;	// Rasterization of the jobs
+	};
+
+	CPURasterizer(uint32_t numWorkers = 0);
+	virtual ~CPURasterizer();
+
+	void SetRenderTargets(TiledSurface* pColorTarget, TiledSurface* pDepth);
+	void SetViewport(float width, float height);
+	void SetPixelShader(const PixelShader& pixelShader);
+	void SetSplitThreshold(uint32_t numBins);
+	bool SetTileSize(uint32_t tileSizeLog, uint32_t tileToBinLog);
+	void Draw(const DirectX::XMFLOAT4* pVertexPos, uint32_t numTriangles);
+	// Runs only the pixel stage over bins filled elsewhere, e.g. by another pool in the
+	// front end of CPUFramePipeline. The viewport and the bin size of the engine must
+	// match those of the rasterizer.
+	void Rasterize(const BinEngine& binEngine, const DirectX::XMFLOAT4* pVertexPos);
+
+	const BinEngine& GetBinEngine() const;
+	const TileScheduler& GetScheduler() const;
+	const StageTimes& GetStageTimes() const;
+	uint32_t GetNumJobs() const;
+	uint32_t GetTileSizeLog() const;
+	uint32_t GetTileToBinLog() const;
+
+	// A split bin becomes up to (1 << SplitLog) x (1 << SplitLog) jobs, of no less than a
+	// TILE_SIZE x TILE_SIZE tile of the surfaces
+	static const uint32_t SplitLog = 2;
+
+	// Supported tile sizes, from 4x4 to 16x16 pixels, and 4x4 or 8x8 tiles per bin
+	static const uint32_t MinTileSizeLog = 2;
+	static const uint32_t MaxTileSizeLog = 4;
+	static const uint32_t MinTileToBinLog = 2;
+	static const uint32_t MaxTileToBinLog = 3;
+
+protected:
+	struct Job
+	{
+		uint32_t BinIdx;
+		uint32_t Left;
+		uint32_t Top;
+		uint32_t Right;
+		uint32_t Bottom;
+	};
+
+	void rasterize(const BinEngine& binEngine, const DirectX::XMFLOAT4* pVertexPos, uint32_t numTriangles);
+	void generateJobs();
+	void rasterizeJob(const Job& job);
+
+	template<uint32_t TileSizeLog>
+	void rasterizeJob(const Job& job);
+	template<uint32_t TileSizeLog>
+	void rasterizeTriangle(uint32_t primId, const Job& job);
+
+	ThreadPool		m_threadPool;
+	BinEngine		m_binEngine;
+	TileScheduler	m_scheduler;
+	FrameGraph		m_stageGraph;
+	std::vector<Job> m_jobs;
+
+	const BinEngine* m_pBins;	// The engine of the draw being rasterized
+
+	PixelShader		m_pixelShader;
+	TiledSurface*	m_pColorTarget;
+	TiledSurface*	m_pDepth;
+
+	const DirectX::XMFLOAT4* m_pVertexPos;
+	float			m_width;
+	float			m_height;
+	uint32_t		m_tileSizeLog;
+	uint32_t		m_tileToBinLog;
+
+	StageTimes		m_stageTimes;
+};
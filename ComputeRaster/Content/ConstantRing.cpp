@@ -0,0 +1,93 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ConstantRing.h"
+
+using namespace std;
+using namespace XUSG;
+
+ConstantRing::ConstantRing() :
+	m_pData(nullptr),
+	m_byteWidth(0),
+	m_head(0),
+	m_frameBegins(),
+	m_isSlotUsed(),
+	m_frameIndex(0)
+{
+}
+
+ConstantRing::~ConstantRing()
+{
+}
+
+bool ConstantRing::Create(const Device& device, uint32_t byteWidth, const wchar_t* name)
+{
+	// The buffer is split into the CBVs of the maximum size, though the slices are bound
+	// as root CBVs
+	assert(byteWidth % MaxSliceSize == 0);
+	m_buffer = ConstantBuffer::MakeUnique();
+	N_RETURN(m_buffer->Create(device, byteWidth, byteWidth / MaxSliceSize,
+		nullptr, MemoryType::UPLOAD, name), false);
+
+	// Upload buffers stay mapped for their lifetime
+	m_pData = static_cast<uint8_t*>(m_buffer->Map());
+	N_RETURN(m_pData, false);
+	m_byteWidth = byteWidth;
+
+	return true;
+}
+
+void ConstantRing::BeginFrame(uint32_t frameIndex)
+{
+	// The previous frame of this slot has completed on the GPU
+	assert(frameIndex < FrameCount);
+	m_frameIndex = frameIndex;
+	m_frameBegins[frameIndex] = m_head;
+	m_isSlotUsed[frameIndex] = true;
+}
+
+ConstantRing::Slice ConstantRing::Allocate(uint32_t size)
+{
+	assert(size <= MaxSliceSize);
+	const auto alignedSize = (size + Alignment - 1) & ~(Alignment - 1);
+
+	// A slice never wraps around the end of the buffer
+	auto begin = m_head;
+	const auto offset = static_cast<uint32_t>(begin % m_byteWidth);
+	if (offset + alignedSize > m_byteWidth) begin += m_byteWidth - offset;
+
+	// The oldest frame in flight bounds the ring
+	Slice slice = {};
+	if (begin + alignedSize - getTail() > m_byteWidth)
+	{
+		assert(!"The constant ring is full");
+
+		return slice;
+	}
+
+	m_head = begin + alignedSize;
+	slice.Offset = static_cast<uint32_t>(begin % m_byteWidth);
+	slice.pData = m_pData + slice.Offset;
+
+	return slice;
+}
+
+const Resource& ConstantRing::GetResource() const
+{
+	return m_buffer->GetResource();
+}
+
+uint32_t ConstantRing::GetUsedSize() const
+{
+	return static_cast<uint32_t>(m_head - getTail());
+}
+
+uint64_t ConstantRing::getTail() const
+{
+	auto tail = m_head;
+	for (auto i = 0u; i < FrameCount; ++i)
+		if (m_isSlotUsed[i]) tail = (min)(tail, m_frameBegins[i]);
+
+	return tail;
+}
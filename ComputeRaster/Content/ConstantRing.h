@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+#include "SharedConst.h"
+
+//--------------------------------------------------------------------------------------
+// Ring allocator of the constants of the draws and the frames, in a persistently mapped
+// upload buffer. The slices of each frame slot are recycled in the BeginFrame() of the
+// slot, after the fence of the slot has been waited for, while those of the other slots
+// may still be read by the GPU, so writing constants never creates a buffer.
+//--------------------------------------------------------------------------------------
+class ConstantRing
+{
+public:
+	struct Slice
+	{
+		void*		pData;	// nullptr if the ring is full
+		uint32_t	Offset;	// In bytes from the start of the buffer, for root CBVs
+	};
+
+	ConstantRing();
+	virtual ~ConstantRing();
+
+	bool Create(const XUSG::Device& device, uint32_t byteWidth, const wchar_t* name = L"ConstantRing");
+	void BeginFrame(uint32_t frameIndex);
+	Slice Allocate(uint32_t size);
+
+	const XUSG::Resource& GetResource() const;
+	uint32_t GetUsedSize() const;	// Of the frames that may be in flight
+
+	static const uint32_t FrameCount = FRAME_COUNT;
+	static const uint32_t Alignment = 256;		// Placement alignment of constant buffers
+	static const uint32_t MaxSliceSize = 65536;	// Size limit of a constant buffer view
+
+protected:
+	uint64_t getTail() const;
+
+	XUSG::ConstantBuffer::uptr m_buffer;
+	uint8_t*	m_pData;
+	uint32_t	m_byteWidth;
+
+	// The offsets grow monotonically, wrapping into the buffer modulo its width
+	uint64_t	m_head;
+	uint64_t	m_frameBegins[FrameCount];
+	bool		m_isSlotUsed[FrameCount];
+	uint32_t	m_frameIndex;
+};
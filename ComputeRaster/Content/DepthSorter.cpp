@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "DepthSorter.h"
+
+using namespace std;
+using namespace DirectX;
+
+DepthSorter::DepthSorter(uint32_t movesPerItem) :
+	m_movesPerItem(movesPerItem),
+	m_isOrderValid(false),
+	m_isFullSort(false)
+{
+}
+
+DepthSorter::~DepthSorter()
+{
+}
+
+void DepthSorter::SetItems(uint32_t numItems, const XMFLOAT3* pCenters)
+{
+	m_centers.assign(pCenters, pCenters + numItems);
+	m_depths.resize(numItems);
+	m_order.resize(numItems);
+	for (auto i = 0u; i < numItems; ++i) m_order[i] = i;
+	m_isOrderValid = false;
+}
+
+void DepthSorter::Sort(FXMMATRIX worldView)
+{
+	// The view-space depth is the dot product with the z column of the row-major matrix
+	const auto col = XMMatrixTranspose(worldView).r[2];
+	const auto numItems = static_cast<uint32_t>(m_centers.size());
+	for (auto i = 0u; i < numItems; ++i)
+	{
+		const auto center = XMVectorSetW(XMLoadFloat3(&m_centers[i]), 1.0f);
+		m_depths[i] = XMVectorGetX(XMVector4Dot(center, col));
+	}
+
+	// Re-sort the order of the previous frame, unless the view changed too much
+	m_isFullSort = !m_isOrderValid || !insertionSort();
+	if (m_isFullSort)
+		sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b)
+			{ return m_depths[a] < m_depths[b]; });
+	m_isOrderValid = true;
+}
+
+const uint32_t* DepthSorter::GetOrder() const
+{
+	return m_order.data();
+}
+
+uint32_t DepthSorter::GetNumItems() const
+{
+	return static_cast<uint32_t>(m_order.size());
+}
+
+bool DepthSorter::IsFullSort() const
+{
+	return m_isFullSort;
+}
+
+bool DepthSorter::insertionSort()
+{
+	// An aborted insertion leaves a permutation behind, which the full sort accepts
+	const auto numItems = static_cast<uint32_t>(m_order.size());
+	auto budget = static_cast<uint64_t>(m_movesPerItem) * numItems;
+	for (auto i = 1u; i < numItems; ++i)
+	{
+		const auto item = m_order[i];
+		const auto depth = m_depths[item];
+		auto j = i;
+		for (; j > 0 && m_depths[m_order[j - 1]] > depth; --j)
+		{
+			if (budget-- == 0)
+			{
+				m_order[j] = item;
+
+				return false;
+			}
+			m_order[j] = m_order[j - 1];
+		}
+		m_order[j] = item;
+	}
+
+	return true;
+}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+//--------------------------------------------------------------------------------------
+// Orders items, such as the draws of a frame or the clusters of a mesh, front to back
+// by the view-space depth of their centers, so that the occluders reach the depth
+// early-outs first. The order of the previous frame is re-sorted by insertion, which
+// is linear when the camera moves a little; a full sort takes over once the insertion
+// exceeds its budget of moves.
+//--------------------------------------------------------------------------------------
+class DepthSorter
+{
+public:
+	DepthSorter(uint32_t movesPerItem = 8);
+	virtual ~DepthSorter();
+
+	void SetItems(uint32_t numItems, const DirectX::XMFLOAT3* pCenters);
+	void Sort(DirectX::FXMMATRIX worldView);
+
+	const uint32_t* GetOrder() const;
+	uint32_t GetNumItems() const;
+	bool IsFullSort() const;
+
+protected:
+	bool insertionSort();
+
+	std::vector<DirectX::XMFLOAT3>	m_centers;
+	std::vector<uint32_t>	m_order;
+	std::vector<float>		m_depths;
+
+	uint32_t	m_movesPerItem;
+	bool		m_isOrderValid;
+	bool		m_isFullSort;
+};
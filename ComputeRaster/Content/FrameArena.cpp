@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FrameArena.h"
+
+using namespace std;
+
+// Offset from the start of the block, at which the address is aligned. The blocks
+// themselves are only aligned for the fundamental types.
+static size_t alignOffset(const uint8_t* pData, size_t offset, size_t alignment)
+{
+	const auto base = reinterpret_cast<uintptr_t>(pData);
+
+	return static_cast<size_t>(((base + offset + alignment - 1) & ~(alignment - 1)) - base);
+}
+
+FrameArena::FrameArena(size_t blockSize) :
+	m_slots(),
+	m_frameIndex(0),
+	m_blockSize(blockSize),
+	m_numBlockAllocations(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+}
+
+void FrameArena::Reset(uint32_t frameIndex)
+{
+	assert(frameIndex < FrameCount);
+	m_frameIndex = frameIndex;
+
+	auto& slot = m_slots[frameIndex];
+	slot.BlockIdx = 0;
+	slot.Offset = 0;
+	slot.UsedSize = 0;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	auto& slot = m_slots[m_frameIndex];
+
+	// Find the first retained block that fits, starting from the current one
+	while (slot.BlockIdx < slot.Blocks.size())
+	{
+		const auto& block = slot.Blocks[slot.BlockIdx];
+		const auto offset = alignOffset(block.Data.get(), slot.Offset, alignment);
+		if (offset + size <= block.Size)
+		{
+			slot.Offset = offset + size;
+			slot.UsedSize += size;
+
+			return block.Data.get() + offset;
+		}
+
+		++slot.BlockIdx;
+		slot.Offset = 0;
+	}
+
+	// Grow the slot; this only happens until the working set has been reached.
+	Block block;
+	block.Size = (max)(m_blockSize, size + alignment);
+	block.Data = make_unique<uint8_t[]>(block.Size);
+	slot.Blocks.push_back(move(block));
+	++m_numBlockAllocations;
+
+	const auto offset = alignOffset(slot.Blocks.back().Data.get(), 0, alignment);
+	slot.BlockIdx = static_cast<uint32_t>(slot.Blocks.size() - 1);
+	slot.Offset = offset + size;
+	slot.UsedSize += size;
+
+	return slot.Blocks.back().Data.get() + offset;
+}
+
+uint32_t FrameArena::GetNumBlockAllocations() const
+{
+	return m_numBlockAllocations;
+}
+
+size_t FrameArena::GetUsedSize() const
+{
+	return m_slots[m_frameIndex].UsedSize;
+}
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SharedConst.h"
+
+//--------------------------------------------------------------------------------------
+// Linear allocator for the transient per-frame objects. Each frame slot owns a list of
+// blocks that is rewound in Reset(); blocks are kept for the following frames, so
+// once the arena has grown to the working set, it allocates no more blocks.
+//--------------------------------------------------------------------------------------
+class FrameArena
+{
+public:
+	FrameArena(size_t blockSize = 64 * 1024);
+	virtual ~FrameArena();
+
+	void Reset(uint32_t frameIndex);
+	// The alignment must be a power of 2
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	template<typename T>
+	T* Allocate(uint32_t num);
+
+	// Only counts the blocks of the arena, not the heap allocations of its users
+	uint32_t GetNumBlockAllocations() const;
+	size_t GetUsedSize() const;
+
+	static const uint32_t FrameCount = FRAME_COUNT;
+
+protected:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> Data;
+		size_t Size;
+	};
+
+	struct Slot
+	{
+		std::vector<Block> Blocks;
+		uint32_t BlockIdx;
+		size_t Offset;
+		size_t UsedSize;
+	};
+
+	Slot		m_slots[FrameCount];
+	uint32_t	m_frameIndex;
+	size_t		m_blockSize;
+	uint32_t	m_numBlockAllocations;
+};
+
+// The debug new macro of stdafx.h cannot expand a placement new.
+#pragma push_macro("new")
+#undef new
+
+template<typename T>
+T* FrameArena::Allocate(uint32_t num)
+{
+	static_assert(std::is_trivially_destructible<T>::value,
+		"FrameArena never runs destructors of the allocated objects");
+
+	const auto p = static_cast<T*>(Allocate(sizeof(T) * num, alignof(T)));
+	for (auto i = 0u; i < num; ++i) new (&p[i]) T;
+
+	return p;
+}
+
+#pragma pop_macro("new")
@@ -0,0 +1,243 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include "FrameGraph.h"
+#include "ThreadPool.h"
+#include "Tracer.h"
+
+using namespace std;
+using namespace XUSG;
+
+// Stable sort in place. Unlike stable_sort(), it never allocates a temporary buffer, and
+// the nearly sorted accesses and passes of a graph take it linear time.
+template<typename T, typename Less>
+static void insertionSort(vector<T>& values, Less less)
+{
+	for (size_t i = 1; i < values.size(); ++i)
+	{
+		const auto value = values[i];
+		auto j = i;
+		for (; j > 0 && less(value, values[j - 1]); --j) values[j] = values[j - 1];
+		values[j] = value;
+	}
+}
+
+FrameGraph::FrameGraph() :
+	m_capacity(0),
+	m_numGrowths(0)
+{
+}
+
+FrameGraph::~FrameGraph()
+{
+}
+
+void FrameGraph::Reset()
+{
+	m_passes.clear();
+	m_resources.clear();
+	m_accesses.clear();
+	m_order.clear();
+	m_levelStarts.clear();
+}
+
+uint32_t FrameGraph::ImportResource(ResourceBase* pResource, bool isPromoted)
+{
+	Resource resource = {};
+	resource.pResource = pResource;
+	resource.IsPromoted = isPromoted;
+	m_resources.emplace_back(resource);
+
+	return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint32_t FrameGraph::AddPass(const wchar_t* name, const PassFunc& func)
+{
+	Pass pass;
+	pass.Name = name;
+	pass.Func = func;
+	pass.Level = 0;
+	m_passes.emplace_back(pass);
+
+	return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+void FrameGraph::Read(uint32_t pass, uint32_t resource, ResourceState state)
+{
+	assert(pass < m_passes.size() && resource < m_resources.size());
+	m_accesses.push_back({ pass, resource, state, false });
+}
+
+void FrameGraph::Write(uint32_t pass, uint32_t resource, ResourceState state)
+{
+	assert(pass < m_passes.size() && resource < m_resources.size());
+	m_accesses.push_back({ pass, resource, state, true });
+}
+
+void FrameGraph::Compile()
+{
+	// The passes are declared in a valid order, so each pass only depends on the
+	// accesses of the passes before it.
+	insertionSort(m_accesses, [](const Access& a, const Access& b) { return a.Pass < b.Pass; });
+
+	// A read in the current state may share the level of the state change, and must
+	// follow a write; any other access changes the state, so it must follow all the
+	// accesses before it.
+	auto& trackers = m_trackers;
+	trackers.assign(m_resources.size(), Tracker{ 0, 0, ResourceState::COMMON, false });
+
+	auto numLevels = 0u;
+	for (auto i = 0u; i < m_accesses.size();)
+	{
+		const auto pass = m_accesses[i].Pass;
+		auto end = i;
+		while (end < m_accesses.size() && m_accesses[end].Pass == pass) ++end;
+
+		auto level = 0u;
+		for (auto j = i; j < end; ++j)
+		{
+			const auto& access = m_accesses[j];
+			const auto& tracker = trackers[access.Resource];
+			const auto isStateRead = !access.IsWrite && tracker.HasState && tracker.State == access.State;
+			level = (max)(level, isStateRead ? tracker.MinReadLevel : tracker.MinChangeLevel);
+		}
+
+		for (auto j = i; j < end; ++j)
+		{
+			const auto& access = m_accesses[j];
+			auto& tracker = trackers[access.Resource];
+			const auto isStateRead = !access.IsWrite && tracker.HasState && tracker.State == access.State;
+			if (!isStateRead)
+			{
+				tracker.State = access.State;
+				tracker.HasState = true;
+				tracker.MinReadLevel = access.IsWrite ? level + 1 : level;
+			}
+			tracker.MinChangeLevel = (max)(tracker.MinChangeLevel, level + 1);
+		}
+
+		m_passes[pass].Level = level;
+		numLevels = (max)(numLevels, level + 1);
+		i = end;
+	}
+
+	// Passes without accesses run in the first level
+	m_order.resize(m_passes.size());
+	for (auto i = 0u; i < m_order.size(); ++i) m_order[i] = i;
+	insertionSort(m_order, [this](uint32_t a, uint32_t b) { return m_passes[a].Level < m_passes[b].Level; });
+
+	m_levelStarts.assign(numLevels + 1, static_cast<uint32_t>(m_order.size()));
+	for (auto i = static_cast<uint32_t>(m_order.size()); i > 0; --i)
+		m_levelStarts[m_passes[m_order[i - 1]].Level] = i - 1;
+	if (!m_levelStarts.empty()) m_levelStarts[0] = 0;
+	for (auto i = numLevels; i > 0; --i)
+		m_levelStarts[i - 1] = (min)(m_levelStarts[i - 1], m_levelStarts[i]);
+
+	m_barriers.resize(m_accesses.size());
+
+	// The containers are only cleared, never shrunk, so any growth changes the sum
+	const auto capacity = m_passes.capacity() + m_resources.capacity() + m_accesses.capacity() +
+		m_order.capacity() + m_levelStarts.capacity() + m_barriers.capacity() + m_trackers.capacity();
+	if (capacity != m_capacity)
+	{
+		m_capacity = capacity;
+		++m_numGrowths;
+	}
+}
+
+void FrameGraph::Execute(CommandList* pCommandList)
+{
+	const auto numLevels = GetNumLevels();
+	for (auto i = 0u; i < numLevels; ++i)
+	{
+		// Transition the resources of the whole level at once
+		auto numBarriers = 0u;
+		for (const auto& access : m_accesses)
+		{
+			auto& resource = m_resources[access.Resource];
+			if (m_passes[access.Pass].Level != i || !resource.pResource) continue;
+
+			const auto n = resource.pResource->SetBarrier(m_barriers.data(), access.State, numBarriers);
+			if (!resource.IsPromoted) numBarriers = n;
+			resource.IsPromoted = false;
+		}
+		if (numBarriers > 0) pCommandList->Barrier(numBarriers, m_barriers.data());
+
+		for (auto j = m_levelStarts[i]; j < m_levelStarts[i + 1]; ++j)
+		{
+			const auto& pass = m_passes[m_order[j]];
+			TRACE_SCOPE_INDEX(STAGE, pass.Name, i);
+			pass.Func(pCommandList);
+		}
+	}
+}
+
+void FrameGraph::Execute(ThreadPool& threadPool)
+{
+	// The task only captures the state of the level as a whole, which fits the small
+	// buffer of std::function, so that the execution allocates nothing.
+	struct
+	{
+		const FrameGraph* pGraph;
+		atomic<uint32_t> Next;
+		uint32_t End;
+		uint32_t Level;
+	} state;
+	state.pGraph = this;
+
+	const auto numLevels = GetNumLevels();
+	for (auto i = 0u; i < numLevels; ++i)
+	{
+		const auto start = m_levelStarts[i];
+		const auto end = m_levelStarts[i + 1];
+		if (end - start == 1)
+		{
+			const auto& pass = m_passes[m_order[start]];
+			TRACE_SCOPE_INDEX(STAGE, pass.Name, i);
+			pass.Func(nullptr);
+			continue;
+		}
+
+		state.Next = start;
+		state.End = end;
+		state.Level = i;
+		const auto pState = &state;
+		threadPool.Execute([pState](uint32_t)
+		{
+			const auto& graph = *pState->pGraph;
+			for (auto j = pState->Next++; j < pState->End; j = pState->Next++)
+			{
+				const auto& pass = graph.m_passes[graph.m_order[j]];
+				TRACE_SCOPE_INDEX(STAGE, pass.Name, pState->Level);
+				pass.Func(nullptr);
+			}
+		});
+	}
+}
+
+uint32_t FrameGraph::GetNumPasses() const
+{
+	return static_cast<uint32_t>(m_passes.size());
+}
+
+uint32_t FrameGraph::GetNumLevels() const
+{
+	return m_levelStarts.empty() ? 0 : static_cast<uint32_t>(m_levelStarts.size() - 1);
+}
+
+const wchar_t* FrameGraph::GetPassName(uint32_t pass) const
+{
+	return m_passes[pass].Name;
+}
+
+uint32_t FrameGraph::GetPassLevel(uint32_t pass) const
+{
+	return m_passes[pass].Level;
+}
+
+uint32_t FrameGraph::GetNumGrowths() const
+{
+	return m_numGrowths;
+}
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+
+class ThreadPool;
+
+//--------------------------------------------------------------------------------------
+// Graph of the passes of a frame, each declaring the resources it reads and writes.
+// Compile() derives the dependencies from the order of the accesses, and groups the
+// passes into levels, none of which depends on another of its level, and each level is
+// recorded after a single batch of the barriers to the declared states. On the CPU,
+// the passes of a level run concurrently on a thread pool instead.
+// The graph is rebuilt per frame, reusing the capacities of the previous builds, so
+// that neither the rebuild nor the compilation allocates in the steady state.
+//--------------------------------------------------------------------------------------
+class FrameGraph
+{
+public:
+	using PassFunc = std::function<void(XUSG::CommandList* pCommandList)>;
+
+	FrameGraph();
+	virtual ~FrameGraph();
+
+	void Reset();
+	// Resources without a GPU resource only order the passes. The first transition of a
+	// promoted resource updates its state without a barrier, for the resources that the
+	// implicit promotion of their first access in the command list covers.
+	uint32_t ImportResource(XUSG::ResourceBase* pResource = nullptr, bool isPromoted = false);
+	uint32_t AddPass(const wchar_t* name, const PassFunc& func);
+	void Read(uint32_t pass, uint32_t resource, XUSG::ResourceState state = XUSG::ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	void Write(uint32_t pass, uint32_t resource, XUSG::ResourceState state = XUSG::ResourceState::UNORDERED_ACCESS);
+	void Compile();
+	void Execute(XUSG::CommandList* pCommandList);
+	// Runs the passes of the CPU backend, without barriers and with a null command list.
+	// A level of a single pass runs on the calling thread, so that the pass may spread
+	// across the pool by itself; the passes of a wider level are taken by the workers,
+	// so they must not use the pool.
+	void Execute(ThreadPool& threadPool);
+
+	uint32_t GetNumPasses() const;
+	uint32_t GetNumLevels() const;
+	const wchar_t* GetPassName(uint32_t pass) const;
+	uint32_t GetPassLevel(uint32_t pass) const;
+	// Compilations that have grown the capacities of the graph, i.e. allocated
+	uint32_t GetNumGrowths() const;
+
+protected:
+	struct Access
+	{
+		uint32_t Pass;
+		uint32_t Resource;
+		XUSG::ResourceState State;
+		bool IsWrite;
+	};
+
+	struct Pass
+	{
+		const wchar_t* Name;
+		PassFunc	Func;
+		uint32_t	Level;
+	};
+
+	struct Resource
+	{
+		XUSG::ResourceBase* pResource;
+		bool		IsPromoted;
+	};
+
+	// State of a resource while the levels are derived
+	struct Tracker
+	{
+		uint32_t MinReadLevel;
+		uint32_t MinChangeLevel;
+		XUSG::ResourceState State;
+		bool HasState;
+	};
+
+	std::vector<Pass>		m_passes;
+	std::vector<Resource>	m_resources;
+	std::vector<Access>		m_accesses;
+	std::vector<uint32_t>	m_order;		// Passes sorted by level
+	std::vector<uint32_t>	m_levelStarts;	// Start of each level in m_order
+	std::vector<XUSG::ResourceBarrier> m_barriers;
+
+	// Scratch of Compile()
+	std::vector<Tracker>	m_trackers;
+
+	size_t		m_capacity;
+	uint32_t	m_numGrowths;
+};
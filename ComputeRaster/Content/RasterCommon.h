@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SharedConst.h"
+
+//--------------------------------------------------------------------------------------
+// CPU counterparts of the raster helpers in Common.hlsli, so that the CPU stages
+// cull, bin and cover primitives exactly like the compute shaders do.
+//--------------------------------------------------------------------------------------
+namespace RasterCommon
+{
+	//--------------------------------------------------------------------------------------
+	// Triangle edge functions, evaluated relative to the minimum corner.
+	//--------------------------------------------------------------------------------------
+	struct EdgeFunctions
+	{
+		DirectX::XMFLOAT2 N[3];
+		float W[3];
+		DirectX::XMFLOAT2 MinPt;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Cull a primitive to the view frustum defined in clip space. Vertices outside
+	// different planes may still enclose the frustum, so only the primitives outside a
+	// single plane are culled, and, as nothing clips the primitives, those with no vertex
+	// inside and any behind the near plane.
+	//--------------------------------------------------------------------------------------
+	inline bool CullPrimitive(const DirectX::XMFLOAT4 primVPos[3])
+	{
+		auto planes = 0x3fu;
+		auto isFullOutside = true;
+		auto isBehind = false;
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto& v = primVPos[i];
+			const auto outside = (v.x < -v.w ? 0x1u : 0u) | (v.x > v.w ? 0x2u : 0u) |
+				(v.y < -v.w ? 0x4u : 0u) | (v.y > v.w ? 0x8u : 0u) |
+				(v.z < 0.0f ? 0x10u : 0u) | (v.z > v.w ? 0x20u : 0u);
+			planes &= outside;
+			isFullOutside = isFullOutside && outside != 0;
+			isBehind = isBehind || v.z < 0.0f;
+		}
+
+		return planes != 0 || (isFullOutside && isBehind);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Transform a vector in homogeneous clip space to the screen space.
+	//--------------------------------------------------------------------------------------
+	inline DirectX::XMFLOAT4 ClipToScreen(const DirectX::XMFLOAT4& pos, float width, float height)
+	{
+		const auto rhw = 1.0f / pos.w;
+
+		return DirectX::XMFLOAT4((pos.x * rhw * 0.5f + 0.5f) * width,
+			(-pos.y * rhw * 0.5f + 0.5f) * height, pos.z * rhw, rhw);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Transform a primitive given in clip space to screen space.
+	//--------------------------------------------------------------------------------------
+	inline void ToScreenSpace(DirectX::XMFLOAT4 primVPos[3], float width, float height)
+	{
+		for (uint8_t i = 0; i < 3; ++i)
+			primVPos[i] = ClipToScreen(primVPos[i], width, height);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Determinant
+	//--------------------------------------------------------------------------------------
+	inline float Determinant(const DirectX::XMFLOAT2& a, const DirectX::XMFLOAT2& b, const DirectX::XMFLOAT2& c)
+	{
+		return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Move the vertex by the pixel bias.
+	//--------------------------------------------------------------------------------------
+	inline DirectX::XMFLOAT2 Scale(const DirectX::XMFLOAT2& pv, const DirectX::XMFLOAT2& cv,
+		const DirectX::XMFLOAT2& nv, float pixelBias = 0.5f)
+	{
+		// Edge lines as planes in homogeneous 2D space
+		const float plane0[] = { cv.y - pv.y, pv.x - cv.x, (cv.x - pv.x) * pv.y - (cv.y - pv.y) * pv.x };
+		const float plane1[] = { nv.y - cv.y, cv.x - nv.x, (nv.x - cv.x) * cv.y - (nv.y - cv.y) * cv.x };
+		const auto z0 = plane0[2] - pixelBias * (fabsf(plane0[0]) + fabsf(plane0[1]));
+		const auto z1 = plane1[2] - pixelBias * (fabsf(plane1[0]) + fabsf(plane1[1]));
+
+		// Intersection of the 2 moved edges
+		const auto x = plane0[1] * z1 - z0 * plane1[1];
+		const auto y = z0 * plane1[0] - plane0[0] * z1;
+		const auto z = plane0[0] * plane1[1] - plane0[1] * plane1[0];
+
+		return DirectX::XMFLOAT2(x / z, y / z);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Scale the primitive vertices by the pixel bias.
+	//--------------------------------------------------------------------------------------
+	inline void Scale(DirectX::XMFLOAT2 sv[3], const DirectX::XMFLOAT2 v[3], float pixelBias)
+	{
+		sv[0] = Scale(v[2], v[0], v[1], pixelBias);
+		sv[1] = Scale(v[0], v[1], v[2], pixelBias);
+		sv[2] = Scale(v[1], v[2], v[0], pixelBias);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Triangle edge equation setup.
+	//--------------------------------------------------------------------------------------
+	inline void SetupEdgeFunctions(EdgeFunctions& edges, const DirectX::XMFLOAT2 v[3])
+	{
+		edges.N[0] = DirectX::XMFLOAT2(v[1].y - v[2].y, v[2].x - v[1].x);
+		edges.N[1] = DirectX::XMFLOAT2(v[2].y - v[0].y, v[0].x - v[2].x);
+		edges.N[2] = DirectX::XMFLOAT2(v[0].y - v[1].y, v[1].x - v[0].x);
+
+		// Calculate barycentric coordinates at min corner.
+		edges.MinPt.x = (std::min)(v[0].x, (std::min)(v[1].x, v[2].x));
+		edges.MinPt.y = (std::min)(v[0].y, (std::min)(v[1].y, v[2].y));
+		edges.W[0] = Determinant(v[1], v[2], edges.MinPt);
+		edges.W[1] = Determinant(v[2], v[0], edges.MinPt);
+		edges.W[2] = Determinant(v[0], v[1], edges.MinPt);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Compute the unnormalized barycentric coordinates at the point.
+	//--------------------------------------------------------------------------------------
+	inline void ComputeUnnormalizedBarycentric(float w[3], float x, float y, const EdgeFunctions& edges)
+	{
+		const auto dispX = x - edges.MinPt.x;
+		const auto dispY = y - edges.MinPt.y;
+		for (uint8_t i = 0; i < 3; ++i)
+			w[i] = edges.W[i] + edges.N[i].x * dispX + edges.N[i].y * dispY;
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Check if the point is overlapped by a primitive.
+	//--------------------------------------------------------------------------------------
+	inline bool Overlap(float x, float y, const EdgeFunctions& edges)
+	{
+		float w[3];
+		ComputeUnnormalizedBarycentric(w, x, y, edges);
+
+		return w[0] >= 0.0f && w[1] >= 0.0f && w[2] >= 0.0f;
+	}
+}
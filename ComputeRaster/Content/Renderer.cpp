@@ -9,8 +9,26 @@ using namespace std;
 using namespace DirectX;
 using namespace XUSG;
 
+// Frames rendered before the pipeline is expected to have reached its working set
+static const uint32_t g_warmUpFrames = SoftGraphicsPipeline::FrameCount * 2;
+
+// Size of each cascade in the shadow atlas, a multiple of the bin size
+static const uint32_t g_shadowMapSize = 1024;
+
 Renderer::Renderer(const Device& device) :
-	m_device(device)
+	m_device(device),
+	m_prevWorldViewProj(),
+	m_lightViewProjs(),
+	m_bound(0.0f, 0.0f, 0.0f, 1.0f),
+	m_coarseShading(0.0f),
+	m_cacheRefreshPeriod(0),
+	m_numFrames(0),
+	m_numFrameAllocations(0),
+	m_depthPrepass(false),
+	m_shadowAtlas(false),
+	m_frontToBack(true),
+	m_isDirty(true),
+	m_frameWork(FrameWork::FULL)
 {
 }
 
@@ -24,6 +42,8 @@ bool Renderer::Init(CommandList* pCommandList, uint32_t width,
 {
 	m_viewport.x = static_cast<float>(width);
 	m_viewport.y = static_cast<float>(height);
+	m_renderSize = m_viewport;
+	m_prevRenderSize = m_viewport;
 	m_posScale = posScale;
 
 	X_RETURN(m_softGraphicsPipeline, make_unique<SoftGraphicsPipeline>(m_device), false);
@@ -34,45 +54,40 @@ bool Renderer::Init(CommandList* pCommandList, uint32_t width,
 	N_RETURN(m_colorTarget->Create(m_device, width, height, Format::R8G8B8A8_UNORM, 1,
 		ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS), false);
 
+	// Create output target for the upscaling of the dynamic resolution
+	m_outputTarget = Texture2D::MakeUnique();
+	N_RETURN(m_outputTarget->Create(m_device, width, height, Format::R8G8B8A8_UNORM, 1,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1, MemoryType::DEFAULT, false, L"OutputTarget"), false);
+
 	// Create depth buffer
 	N_RETURN(m_softGraphicsPipeline->CreateDepthBuffer(m_depth, width,
 		height, Format::R32_UINT), false);
+	N_RETURN(m_softGraphicsPipeline->CreateDepthBuffer(m_shadowDepth, g_shadowMapSize * NumCascades,
+		g_shadowMapSize, Format::R32_UINT), false);
+
+	// Create shading-rate image
+	m_shadingRate = Texture2D::MakeUnique();
+	N_RETURN(m_softGraphicsPipeline->CreateShadingRateImage(*m_shadingRate, width, height), false);
+
+	// Create temporal cache
+	N_RETURN(m_softGraphicsPipeline->CreateTemporalCache(m_temporalCache, width, height,
+		Format::R8G8B8A8_UNORM, Format::R32_UINT), false);
 	
 	{
+		// The matrices and the lighting are root CBVs of slices of the constant ring
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
-		pipelineLayout->SetRange(0, DescriptorType::CBV, 1, 0);
+		pipelineLayout->SetRootCBV(0, 0);
 		m_softGraphicsPipeline->SetAttribute(0, sizeof(uint32_t[4]), Format::R32G32B32A32_FLOAT, L"Normal");
 		N_RETURN(m_softGraphicsPipeline->CreateVertexShaderLayout(pipelineLayout.get(), 1), false);
 	}
 
 	{
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
-		pipelineLayout->SetRange(0, DescriptorType::CBV, 1, 0);
+		pipelineLayout->SetRootCBV(0, 0);
 		pipelineLayout->SetRange(1, DescriptorType::CBV, 1, 1);
 		N_RETURN(m_softGraphicsPipeline->CreatePixelShaderLayout(pipelineLayout.get(), true, 1, 2, 1), false);
 	}
 
-	// Create constant buffers
-	const auto& frameCount = SoftGraphicsPipeline::FrameCount;
-	m_cbMatrices = ConstantBuffer::MakeUnique();
-	N_RETURN(m_cbMatrices->Create(m_device, sizeof(XMFLOAT4X4[2]) * frameCount, frameCount), false);
-	for (auto i = 0u; i < SoftGraphicsPipeline::FrameCount; ++i)
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0, 1, &m_cbMatrices->GetCBV(i));
-		m_cbvTables[CBV_TABLE_MATRICES + i] = descriptorTable->GetCbvSrvUavTable(m_softGraphicsPipeline->GetDescriptorTableCache());
-	}
-
-	// Per-frame lighting
-	m_cbLighting = ConstantBuffer::MakeUnique();
-	N_RETURN(m_cbLighting->Create(m_device, sizeof(XMFLOAT4[4]) * frameCount, frameCount), false);
-	for (auto i = 0u; i < SoftGraphicsPipeline::FrameCount; ++i)
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0, 1, &m_cbLighting->GetCBV(i));
-		m_cbvTables[CBV_TABLE_LIGHTING + i] = descriptorTable->GetCbvSrvUavTable(m_softGraphicsPipeline->GetDescriptorTableCache());
-	}
-
 	// Immutable material
 	{
 		XMFLOAT3 baseColor(1.0f, 1.0f, 0.5f);
@@ -98,6 +113,37 @@ bool Renderer::Init(CommandList* pCommandList, uint32_t width,
 		objLoader.GetVertices(), objLoader.GetNumVertices(), objLoader.GetVertexStride()), false);
 	N_RETURN(m_softGraphicsPipeline->CreateIndexBuffer(pCommandList, *m_ib,
 		uploaders, objLoader.GetIndices(), m_numIndices, Format::R32_UINT), false);
+
+	// The clusters of CLUSTER_SIZE triangles are sorted by the centers of their bounds
+	{
+		const auto numClusters = DIV_UP(m_numIndices / 3, CLUSTER_SIZE);
+		const auto pVertices = objLoader.GetVertices();
+		const auto pIndices = objLoader.GetIndices();
+		const auto stride = objLoader.GetVertexStride();
+		vector<XMFLOAT3> centers(numClusters);
+		auto meshMin = XMVectorReplicate(FLT_MAX);
+		auto meshMax = XMVectorReplicate(-FLT_MAX);
+		for (auto i = 0u; i < numClusters; ++i)
+		{
+			auto minPt = XMVectorReplicate(FLT_MAX);
+			auto maxPt = XMVectorReplicate(-FLT_MAX);
+			const auto end = (min)(CLUSTER_SIZE * 3 * (i + 1), m_numIndices);
+			for (auto j = CLUSTER_SIZE * 3 * i; j < end; ++j)
+			{
+				const auto pos = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * pIndices[j]]));
+				minPt = XMVectorMin(minPt, pos);
+				maxPt = XMVectorMax(maxPt, pos);
+			}
+			XMStoreFloat3(&centers[i], (minPt + maxPt) * 0.5f);
+			meshMin = XMVectorMin(meshMin, minPt);
+			meshMax = XMVectorMax(meshMax, maxPt);
+		}
+		m_clusterSorter.SetItems(numClusters, centers.data());
+
+		// The cascades of the shadow atlas are fit to the bounding sphere
+		const auto center = (meshMin + meshMax) * 0.5f;
+		XMStoreFloat4(&m_bound, XMVectorSetW(center, XMVectorGetX(XMVector3Length(meshMax - center))));
+	}
 #else
 	const float vbData[] =
 	{
@@ -120,21 +166,75 @@ bool Renderer::Init(CommandList* pCommandList, uint32_t width,
 	return true;
 }
 
-void Renderer::UpdateFrame(uint32_t frameIndex, CXMMATRIX view,
-	CXMMATRIX proj, const XMFLOAT3& eyePt, double time)
+void Renderer::UpdateFrame(CXMMATRIX view, CXMMATRIX proj, const XMFLOAT3& eyePt, double time, float timeStep)
 {
+	// The frame time rates the bin threshold and the resolution in use, which only the
+	// full frames reflect
+	if (m_frameWork == FrameWork::FULL)
+	{
+		m_softGraphicsPipeline->ReportFrameCost(timeStep);
+		m_resolutionScaler.Update(timeStep);
+	}
+
+	// The targets keep their size, and the frame renders into their top-left sub-rectangle
+	const auto scale = m_resolutionScaler.GetScale();
+	m_prevRenderSize = m_renderSize;
+	m_renderSize.x = ceil(m_viewport.x * scale);
+	m_renderSize.y = ceil(m_viewport.y * scale);
+
+	// Each candidate of the bin threshold has to be rated by full frames
+	auto isDirty = m_isDirty || m_softGraphicsPipeline->IsBinThresholdTuning();
+	isDirty = isDirty || m_renderSize.x != m_prevRenderSize.x || m_renderSize.y != m_prevRenderSize.y;
+	m_isDirty = false;
+
 	{
 		struct CBMatrices
 		{
 			XMMATRIX WorldViewProj;
 			XMMATRIX Normal;
 		};
-		const auto pCb = reinterpret_cast<CBMatrices*>(m_cbMatrices->Map(frameIndex));
+		CBMatrices cb;
 		const auto world = XMMatrixScaling(m_posScale.w, m_posScale.w, m_posScale.w) *
 			XMMatrixTranslation(m_posScale.x, m_posScale.y, m_posScale.z);
 		const auto worldInv = XMMatrixInverse(nullptr, world);
-		pCb->WorldViewProj = XMMatrixTranspose(world * view * proj);
-		pCb->Normal = worldInv;
+		const auto worldViewProj = world * view * proj;
+		cb.WorldViewProj = XMMatrixTranspose(worldViewProj);
+		cb.Normal = worldInv;
+		isDirty = updateConstants(&cb, sizeof(cb), m_prevMatrices) || isDirty;
+
+		// Front-to-back order of the clusters, re-sorted from that of the previous frame
+		if (m_frontToBack) m_clusterSorter.Sort(world * view);
+
+		// Maps the clip space of this frame to that of the previous frame for occlusion
+		// culling. The zero matrix of the first frame fails the reprojection, which keeps
+		// all clusters visible. The previous frame may have rendered a sub-rectangle of
+		// another size, so its clip space is rescaled to land on the pixels of that frame
+		// through the viewport of this frame.
+		XMFLOAT4X4 reprojection;
+		const auto prevWorldViewProj = XMLoadFloat4x4(&m_prevWorldViewProj);
+		const auto sx = m_prevRenderSize.x / m_renderSize.x;
+		const auto sy = m_prevRenderSize.y / m_renderSize.y;
+		const auto toPrevRect = XMMatrixScaling(sx, sy, 1.0f) * XMMatrixTranslation(sx - 1.0f, 1.0f - sy, 0.0f);
+		XMStoreFloat4x4(&reprojection, XMMatrixInverse(nullptr, worldViewProj) * prevWorldViewProj * toPrevRect);
+		m_softGraphicsPipeline->SetReprojection(reprojection);
+		XMStoreFloat4x4(&m_prevWorldViewProj, worldViewProj);
+
+		// The multi-view pass maps the world-space positions to each view, and the key
+		// light is static, so the cascades only change with the world
+		cb.WorldViewProj = XMMatrixTranspose(world);
+		isDirty = updateConstants(&cb, sizeof(cb), m_shadowMatrices) || isDirty;
+
+		// The first cascade covers the whole mesh, and the second its central half
+		const auto lightDir = XMVector3Normalize(XMVectorSet(1.0f, 1.0f, -1.0f, 0.0f));
+		const auto center = XMVector3TransformCoord(XMLoadFloat4(&m_bound), world);
+		const auto radius = m_bound.w * m_posScale.w;
+		const auto lightView = XMMatrixLookToLH(center + lightDir * radius, -lightDir, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		for (auto i = 0u; i < NumCascades; ++i)
+		{
+			const auto size = 2.0f * radius / static_cast<float>(1 << i);
+			const auto lightProj = XMMatrixOrthographicLH(size, size, 0.0f, 2.0f * radius);
+			XMStoreFloat4x4(&m_lightViewProjs[i], lightView * lightProj);
+		}
 	}
 
 	{
@@ -145,31 +245,220 @@ void Renderer::UpdateFrame(uint32_t frameIndex, CXMMATRIX view,
 			XMFLOAT4 LightPt;
 			XMFLOAT3 EyePt;
 		};
-		const auto pCb = reinterpret_cast<CBLighting*>(m_cbLighting->Map(frameIndex));
-		pCb->AmbientColor = XMFLOAT4(0.6f, 0.7f, 1.0f, 2.4f);
-		pCb->LightColor = XMFLOAT4(1.0f, 0.7f, 0.5f, (static_cast<float>(sin(time)) * 0.3f + 0.7f) * 3.14f);
-		XMStoreFloat4(&pCb->LightPt, XMVectorSet(1.0f, 1.0f, -1.0, 0.0f));
-		pCb->EyePt = eyePt;
+		CBLighting cb = {};
+		cb.AmbientColor = XMFLOAT4(0.6f, 0.7f, 1.0f, 2.4f);
+		cb.LightColor = XMFLOAT4(1.0f, 0.7f, 0.5f, (static_cast<float>(sin(time)) * 0.3f + 0.7f) * 3.14f);
+		XMStoreFloat4(&cb.LightPt, XMVectorSet(1.0f, 1.0f, -1.0, 0.0f));
+		cb.EyePt = eyePt;
+		const auto isShadingDirty = updateConstants(&cb, sizeof(cb), m_prevLighting);
+		m_frameWork = isDirty ? FrameWork::FULL : (isShadingDirty ? FrameWork::SHADE : FrameWork::NONE);
 	}
 }
 
 void Renderer::Render(CommandList* pCommandList, uint32_t frameIndex)
 {
+	// The targets still hold the previous frame
+	if (m_frameWork == FrameWork::NONE) return;
+
 	// Compute raster rendering
 	const float clearColor[] = { CLEAR_COLOR, 0.0f };
+	m_softGraphicsPipeline->BeginFrame(frameIndex);
+	m_softGraphicsPipeline->SetVertexBuffer(*m_vb);
+	m_softGraphicsPipeline->SetIndexBuffer(*m_ib);
+	m_softGraphicsPipeline->SetClusterOrder(m_frontToBack ? m_clusterSorter.GetOrder() : nullptr);
+
+	// The clears are of the bound targets, so the atlas is rendered before those of the frame
+	if (m_shadowAtlas && m_frameWork == FrameWork::FULL) renderShadowAtlas(pCommandList);
+
 	m_softGraphicsPipeline->SetRenderTargets(1, m_colorTarget.get(), &m_depth);
 	m_softGraphicsPipeline->ClearFloat(*m_colorTarget, clearColor);
-	m_softGraphicsPipeline->ClearDepth(1.0f);
-	m_softGraphicsPipeline->SetViewport(Viewport(0.0f, 0.0f, m_viewport.x, m_viewport.y));
-	m_softGraphicsPipeline->SetVertexBuffer(m_vb->GetSRV());
-	m_softGraphicsPipeline->SetIndexBuffer(m_ib->GetSRV());
-	m_softGraphicsPipeline->VSSetDescriptorTable(0, m_cbvTables[CBV_TABLE_MATRICES + frameIndex]);
-	m_softGraphicsPipeline->PSSetDescriptorTable(0, m_cbvTables[CBV_TABLE_LIGHTING + frameIndex]);
+	m_softGraphicsPipeline->SetViewport(Viewport(0.0f, 0.0f, m_renderSize.x, m_renderSize.y));
+	m_softGraphicsPipeline->SetShadingRateImage(m_coarseShading > 0.0f ? m_shadingRate.get() : nullptr);
+	m_softGraphicsPipeline->SetTemporalCache(m_cacheRefreshPeriod > 0 ? &m_temporalCache : nullptr,
+		(max)(m_cacheRefreshPeriod, 1u));
+	setConstants(0, m_prevMatrices, false);
+	setConstants(0, m_prevLighting, true);
 	m_softGraphicsPipeline->PSSetDescriptorTable(1, m_cbvTables[CBV_TABLE_MATERIAL]);
-	m_softGraphicsPipeline->DrawIndexed(pCommandList, m_numIndices);
+
+	// Only the pixel shading is re-run over the visibility of the previous frame, unless
+	// the pipeline cannot replay it, e.g. after occlusion culling
+	if (m_frameWork != FrameWork::SHADE || !m_softGraphicsPipeline->Reshade(pCommandList))
+	{
+		m_frameWork = FrameWork::FULL;
+		m_softGraphicsPipeline->ClearDepth(1.0f);
+
+		// The prepass resolves the visibility, so that each pixel is shaded only once
+		if (m_depthPrepass)
+		{
+			m_softGraphicsPipeline->SetPassMode(SoftGraphicsPipeline::PassMode::DEPTH_ONLY);
+			m_softGraphicsPipeline->DrawIndexed(pCommandList, m_numIndices);
+			m_softGraphicsPipeline->SetPassMode(SoftGraphicsPipeline::PassMode::DEPTH_EQUAL);
+			if (m_coarseShading > 0.0f)
+				m_softGraphicsPipeline->GenerateShadingRate(pCommandList, *m_shadingRate, m_coarseShading);
+		}
+		m_softGraphicsPipeline->DrawIndexed(pCommandList, m_numIndices);
+		m_softGraphicsPipeline->SetPassMode(SoftGraphicsPipeline::PassMode::DEFAULT);
+
+		// Without the prepass, the rates of the next frame come from the depth of this frame
+		if (m_coarseShading > 0.0f && !m_depthPrepass)
+			m_softGraphicsPipeline->GenerateShadingRate(pCommandList, *m_shadingRate, m_coarseShading);
+	}
+
+	// The history of the next frame is the frame at the render resolution
+	if (m_cacheRefreshPeriod > 0) m_softGraphicsPipeline->UpdateTemporalCache(pCommandList);
+
+	if (m_resolutionScaler.IsEnabled())
+		m_softGraphicsPipeline->Upscale(pCommandList, *m_colorTarget, *m_outputTarget,
+			static_cast<uint32_t>(m_renderSize.x), static_cast<uint32_t>(m_renderSize.y));
+
+	// The first frame is a full one, so once each frame slot has rendered a few frames,
+	// neither the barrier arrays of the draws nor the rebuilds of the raster graph allocate
+	const auto numFrameAllocations = m_softGraphicsPipeline->GetNumFrameAllocations();
+	assert(m_numFrames <= g_warmUpFrames || numFrameAllocations == m_numFrameAllocations);
+	m_numFrameAllocations = numFrameAllocations;
+	++m_numFrames;
+}
+
+void Renderer::SetBinThreshold(float numTiles)
+{
+	m_softGraphicsPipeline->SetBinThreshold(numTiles);
+	m_isDirty = true;
+}
+
+void Renderer::AutoTuneBinThreshold()
+{
+	m_softGraphicsPipeline->AutoTuneBinThreshold();
+	m_isDirty = true;
+}
+
+void Renderer::SetDepthPrepass(bool enable)
+{
+	m_depthPrepass = enable;
+	m_isDirty = true;
+}
+
+void Renderer::SetOcclusionCulling(bool enable)
+{
+	m_softGraphicsPipeline->SetOcclusionCulling(enable);
+	m_isDirty = true;
+}
+
+void Renderer::SetFrontToBack(bool enable)
+{
+	m_frontToBack = enable;
+	m_isDirty = true;
+}
+
+void Renderer::SetCoarseShading(float threshold)
+{
+	m_coarseShading = threshold;
+	m_isDirty = true;
+}
+
+void Renderer::SetTemporalCache(uint32_t refreshPeriod)
+{
+	m_cacheRefreshPeriod = refreshPeriod;
+	m_isDirty = true;
+}
+
+void Renderer::SetFrameTimeBudget(double frameTime, float minScale)
+{
+	// A zero budget renders at the full resolution
+	m_resolutionScaler.SetRange(minScale, 1.0f);
+	m_resolutionScaler.SetTargetFrameTime(frameTime);
+	m_isDirty = true;
+}
+
+void Renderer::SetShadowAtlas(bool enable)
+{
+	m_shadowAtlas = enable;
+	m_isDirty = true;
+}
+
+void Renderer::Invalidate()
+{
+	m_isDirty = true;
 }
 
 Texture2D& Renderer::GetColorTarget()
 {
-	return *m_colorTarget;
+	return m_resolutionScaler.IsEnabled() ? *m_outputTarget : *m_colorTarget;
+}
+
+float Renderer::GetBinThreshold() const
+{
+	return m_softGraphicsPipeline->GetBinThreshold();
+}
+
+bool Renderer::IsBinThresholdTuning() const
+{
+	return m_softGraphicsPipeline->IsBinThresholdTuning();
+}
+
+bool Renderer::IsFrontToBack() const
+{
+	return m_frontToBack;
+}
+
+float Renderer::GetResolutionScale() const
+{
+	return m_resolutionScaler.GetScale();
+}
+
+const SoftGraphicsPipeline::EarlyZStats& Renderer::GetEarlyZStats() const
+{
+	return m_softGraphicsPipeline->GetEarlyZStats();
+}
+
+const SoftGraphicsPipeline::PipelineStats& Renderer::GetPipelineStats() const
+{
+	return m_softGraphicsPipeline->GetPipelineStats();
+}
+
+const SoftGraphicsPipeline::TemporalCacheStats& Renderer::GetTemporalCacheStats() const
+{
+	return m_softGraphicsPipeline->GetTemporalCacheStats();
+}
+
+uint64_t Renderer::GetTransientMemory() const
+{
+	return m_softGraphicsPipeline->GetTransientMemory();
+}
+
+void Renderer::renderShadowAtlas(CommandList* pCommandList)
+{
+	// The cascades are the views of a single pass over the mesh. The atlas is not
+	// sampled by the shading yet.
+	Viewport viewports[NumCascades];
+	for (auto i = 0u; i < NumCascades; ++i)
+		viewports[i] = Viewport(static_cast<float>(g_shadowMapSize * i), 0.0f,
+			static_cast<float>(g_shadowMapSize), static_cast<float>(g_shadowMapSize));
+
+	m_softGraphicsPipeline->SetRenderTargets(0, nullptr, &m_shadowDepth);
+	m_softGraphicsPipeline->SetViewport(Viewport(0.0f, 0.0f,
+		static_cast<float>(g_shadowMapSize * NumCascades), static_cast<float>(g_shadowMapSize)));
+	m_softGraphicsPipeline->SetViews(NumCascades, m_lightViewProjs, viewports);
+	m_softGraphicsPipeline->ClearDepth(1.0f);
+	setConstants(0, m_shadowMatrices, false);
+	m_softGraphicsPipeline->SetPassMode(SoftGraphicsPipeline::PassMode::DEPTH_MULTI_VIEW);
+	m_softGraphicsPipeline->DrawIndexed(pCommandList, m_numIndices);
+	m_softGraphicsPipeline->SetPassMode(SoftGraphicsPipeline::PassMode::DEFAULT);
+}
+
+void Renderer::setConstants(uint32_t i, const vector<uint8_t>& data, bool isPS)
+{
+	const auto slice = m_softGraphicsPipeline->AllocateConstants(static_cast<uint32_t>(data.size()));
+	assert(slice.pData);
+	memcpy(slice.pData, data.data(), data.size());
+	if (isPS) m_softGraphicsPipeline->PSSetConstantBuffer(i, slice);
+	else m_softGraphicsPipeline->VSSetConstantBuffer(i, slice);
+}
+
+bool Renderer::updateConstants(const void* pSrc, size_t size, vector<uint8_t>& prevData)
+{
+	const auto pData = reinterpret_cast<const uint8_t*>(pSrc);
+	const auto isChanged = prevData.size() != size || memcmp(prevData.data(), pData, size) != 0;
+	if (isChanged) prevData.assign(pData, pData + size);
+
+	return isChanged;
 }
@@ -5,6 +5,8 @@
 #pragma once
 
 #include "SoftGraphicsPipeline.h"
+#include "DepthSorter.h"
+#include "ResolutionScaler.h"
 
 class Renderer
 {
@@ -16,38 +18,99 @@ public:
 		std::vector<XUSG::Resource>& uploaders, const char* fileName,
 		const DirectX::XMFLOAT4& posScale);
 
-	void UpdateFrame(uint32_t frameIndex, DirectX::CXMMATRIX view,
-		DirectX::CXMMATRIX proj, const DirectX::XMFLOAT3& eyePt, double time);
+	void UpdateFrame(DirectX::CXMMATRIX view, DirectX::CXMMATRIX proj, const DirectX::XMFLOAT3& eyePt, double time, float timeStep);
 	void Render(XUSG::CommandList* pCommandList, uint32_t frameIndex);
+	void SetBinThreshold(float numTiles);
+	void AutoTuneBinThreshold();
+	void SetDepthPrepass(bool enable);
+	void SetOcclusionCulling(bool enable);
+	void SetFrontToBack(bool enable);
+	void SetCoarseShading(float threshold);
+	// Reuses the shading of the previous frame through the temporal reprojection cache,
+	// reshading every pixel at least once in the refresh period. 0 disables the cache.
+	void SetTemporalCache(uint32_t refreshPeriod);
+	void SetFrameTimeBudget(double frameTime, float minScale = 0.5f);
+	// Renders the cascades of the key light into the views of a shadow atlas, in a
+	// multi-view depth pass. Enabled before the first frame, as the views widen the
+	// vertex positions of the pipeline.
+	void SetShadowAtlas(bool enable);
+	// Forces a full frame after changes that the renderer cannot track, such as those to
+	// the contents of the buffers or the targets
+	void Invalidate();
 
 	XUSG::Texture2D& GetColorTarget();
+	float GetBinThreshold() const;
+	bool IsBinThresholdTuning() const;
+	bool IsFrontToBack() const;
+	float GetResolutionScale() const;
+	const SoftGraphicsPipeline::EarlyZStats& GetEarlyZStats() const;
+	const SoftGraphicsPipeline::PipelineStats& GetPipelineStats() const;
+	const SoftGraphicsPipeline::TemporalCacheStats& GetTemporalCacheStats() const;
+	uint64_t GetTransientMemory() const;
 
 protected:
+	// Work of a frame, determined by the changes of its inputs since the previous frame
+	enum class FrameWork : uint8_t
+	{
+		NONE,	// Nothing changed, so the targets still hold the frame
+		SHADE,	// Only the pixel-shader constants changed, so the visibility is reshaded
+		FULL
+	};
+
 	enum CBVTable : uint8_t
 	{
-		CBV_TABLE_MATRICES,
-		CBV_TABLE_LIGHTING = CBV_TABLE_MATRICES + SoftGraphicsPipeline::FrameCount,
-		CBV_TABLE_MATERIAL = CBV_TABLE_LIGHTING + SoftGraphicsPipeline::FrameCount,
+		CBV_TABLE_MATERIAL,
 
 		NUM_CBV_TABLE
 	};
 
+	static const uint32_t NumCascades = 2;
+
 	XUSG::Device m_device;
 
 	std::unique_ptr<SoftGraphicsPipeline> m_softGraphicsPipeline;
 	XUSG::VertexBuffer::uptr	m_vb;
 	XUSG::IndexBuffer::uptr		m_ib;
-	XUSG::ConstantBuffer::uptr	m_cbMatrices;
-	XUSG::ConstantBuffer::uptr	m_cbLighting;
 	XUSG::ConstantBuffer::uptr	m_cbMaterial;
 
 	XUSG::Texture2D::uptr		m_colorTarget;
+	XUSG::Texture2D::uptr		m_outputTarget;
 	SoftGraphicsPipeline::DepthBuffer m_depth;
+	SoftGraphicsPipeline::DepthBuffer m_shadowDepth;	// Atlas of the cascades side by side
+	XUSG::Texture2D::uptr		m_shadingRate;
+	SoftGraphicsPipeline::TemporalCache m_temporalCache;
 
 	XUSG::DescriptorTable	m_cbvTables[NUM_CBV_TABLE];
 
+	// The constants of the latest frame, written into the constant ring by Render()
+	std::vector<uint8_t>	m_prevMatrices;
+	std::vector<uint8_t>	m_prevLighting;
+	std::vector<uint8_t>	m_shadowMatrices;	// The views take the world-space positions
+
+	DepthSorter				m_clusterSorter;
+	ResolutionScaler		m_resolutionScaler;
+
 	DirectX::XMFLOAT2		m_viewport;
+	DirectX::XMFLOAT2		m_renderSize;
+	DirectX::XMFLOAT2		m_prevRenderSize;
 	DirectX::XMFLOAT4		m_posScale;
+	DirectX::XMFLOAT4X4		m_prevWorldViewProj;
+	DirectX::XMFLOAT4X4		m_lightViewProjs[NumCascades];
+	DirectX::XMFLOAT4		m_bound;			// Bounding sphere of the mesh in object space
 
 	uint32_t				m_numIndices;
+	float					m_coarseShading;
+	uint32_t				m_cacheRefreshPeriod;
+	uint32_t				m_numFrames;
+	uint32_t				m_numFrameAllocations;
+	bool					m_depthPrepass;
+	bool					m_shadowAtlas;
+	bool					m_frontToBack;
+	bool					m_isDirty;
+	FrameWork				m_frameWork;
+
+	void renderShadowAtlas(XUSG::CommandList* pCommandList);
+	void setConstants(uint32_t i, const std::vector<uint8_t>& data, bool isPS);
+
+	static bool updateConstants(const void* pSrc, size_t size, std::vector<uint8_t>& prevData);
 };
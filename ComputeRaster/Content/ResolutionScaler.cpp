@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ResolutionScaler.h"
+
+using namespace std;
+
+// Steps of the scale, so that the render size changes only by whole steps
+static const float g_scaleStep = 1.0f / 64.0f;
+
+// Relative frame-time error below which the scale is kept
+static const double g_tolerance = 0.05;
+
+// Weight of the latest frame in the smoothed frame time
+static const double g_smoothing = 0.2;
+
+ResolutionScaler::ResolutionScaler(float minScale, float maxScale,
+	uint32_t numSettleFrames, float damping) :
+	m_targetFrameTime(0.0),
+	m_frameTime(0.0),
+	m_scale(maxScale),
+	m_minScale(minScale),
+	m_maxScale(maxScale),
+	m_damping(damping),
+	m_numSettleFrames(numSettleFrames),
+	m_settleFrameIdx(0)
+{
+}
+
+ResolutionScaler::~ResolutionScaler()
+{
+}
+
+void ResolutionScaler::SetTargetFrameTime(double frameTime)
+{
+	// A zero budget disables the scaling
+	m_targetFrameTime = frameTime;
+	m_frameTime = 0.0;
+	m_settleFrameIdx = 0;
+	m_scale = m_maxScale;
+}
+
+void ResolutionScaler::SetRange(float minScale, float maxScale)
+{
+	assert(minScale > 0.0f && minScale <= maxScale);
+	m_minScale = minScale;
+	m_maxScale = maxScale;
+	m_scale = (min)((max)(m_scale, m_minScale), m_maxScale);
+}
+
+void ResolutionScaler::Update(double frameTime)
+{
+	if (!IsEnabled()) return;
+
+	// Skip the frames that may still have been rendered at the previous scale
+	if (m_settleFrameIdx < m_numSettleFrames)
+	{
+		++m_settleFrameIdx;
+		return;
+	}
+
+	// The first sample starts the smoothing
+	m_frameTime = m_frameTime > 0.0 ? m_frameTime + (frameTime - m_frameTime) * g_smoothing : frameTime;
+	const auto ratio = m_targetFrameTime / m_frameTime;
+	if (abs(ratio - 1.0) < g_tolerance) return;
+
+	auto scale = m_scale * static_cast<float>(sqrt(ratio));
+	scale = m_scale + (scale - m_scale) * m_damping;
+	scale = round(scale / g_scaleStep) * g_scaleStep;
+	scale = (min)((max)(scale, m_minScale), m_maxScale);
+	if (scale == m_scale) return;
+
+	// The smoothed frame time no longer holds for the new scale
+	m_scale = scale;
+	m_frameTime = 0.0;
+	m_settleFrameIdx = 0;
+}
+
+float ResolutionScaler::GetScale() const
+{
+	return m_scale;
+}
+
+bool ResolutionScaler::IsEnabled() const
+{
+	return m_targetFrameTime > 0.0;
+}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+//--------------------------------------------------------------------------------------
+// Scales the internal render resolution to hold a frame-time budget on a best-effort
+// basis. The cost of the raster stages grows with the pixel count, i.e. the square of
+// the scale, so each update moves the scale part of the way towards the square root of
+// the ratio of the budget to the smoothed frame time. Frames still in flight at the old
+// scale are skipped after each change, and small errors are ignored to avoid jitter.
+//--------------------------------------------------------------------------------------
+class ResolutionScaler
+{
+public:
+	ResolutionScaler(float minScale = 0.5f, float maxScale = 1.0f,
+		uint32_t numSettleFrames = 3, float damping = 0.5f);
+	virtual ~ResolutionScaler();
+
+	void SetTargetFrameTime(double frameTime);
+	void SetRange(float minScale, float maxScale);
+	void Update(double frameTime);
+
+	float GetScale() const;
+	bool IsEnabled() const;
+
+protected:
+	double		m_targetFrameTime;
+	double		m_frameTime;
+	float		m_scale;
+	float		m_minScale;
+	float		m_maxScale;
+	float		m_damping;
+	uint32_t	m_numSettleFrames;
+	uint32_t	m_settleFrameIdx;
+};
@@ -4,6 +4,11 @@
 
 #include "SharedConst.h"
 #include "Common.hlsli"
+#include "EarlyZStats.hlsli"
+#include "PipelineStats.hlsli"
+#if MULTI_VIEW
+#include "MultiView.hlsli"
+#endif
 
 //--------------------------------------------------------------------------------------
 // Structures
@@ -34,6 +39,13 @@ struct RasterInfo
 	RasterUavInfo UavInfo;
 };
 
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+#if !MULTI_VIEW && OCCLUSION_CULL < 2
+StructuredBuffer<uint> g_roClusterOrder;
+#endif
+
 //--------------------------------------------------------------------------------------
 // UAV buffers
 //--------------------------------------------------------------------------------------
@@ -49,25 +61,38 @@ RWTexture2D<uint> g_rwBinZ;
 RWStructuredBuffer<uint> g_rwBinPrimCount;
 RWStructuredBuffer<TilePrim> g_rwBinPrimitives;
 
+#if OCCLUSION_CULL
+#include "OcclusionCull.hlsli"
+#endif
+
 //--------------------------------------------------------------------------------------
-// Cull a primitive to the view frustum defined in clip space.
+// Cull a primitive to the view frustum defined in clip space. Vertices outside
+// different planes may still enclose the frustum, so only the primitives outside a
+// single plane are culled, and, as nothing clips the primitives, those with no vertex
+// inside and any behind the near plane.
 //--------------------------------------------------------------------------------------
 bool CullPrimitive(float3x4 primVPos)
 {
+	uint planes = 0x3f;
 	bool isFullOutside = true;
+	bool isBehind = false;
 
 	[unroll]
 	for (uint i = 0; i < 3; ++i)
 	{
-		bool isOutside = false;
-		isOutside = isOutside || abs(primVPos[i].x) > primVPos[i].w;
-		isOutside = isOutside || abs(primVPos[i].y) > primVPos[i].w;
-		isOutside = isOutside || primVPos[i].z < 0.0;
-		isOutside = isOutside || primVPos[i].z > primVPos[i].w;
-		isFullOutside = isFullOutside && isOutside;
+		uint outside = 0;
+		outside |= primVPos[i].x < -primVPos[i].w ? 0x1 : 0;
+		outside |= primVPos[i].x > primVPos[i].w ? 0x2 : 0;
+		outside |= primVPos[i].y < -primVPos[i].w ? 0x4 : 0;
+		outside |= primVPos[i].y > primVPos[i].w ? 0x8 : 0;
+		outside |= primVPos[i].z < 0.0 ? 0x10 : 0;
+		outside |= primVPos[i].z > primVPos[i].w ? 0x20 : 0;
+		planes &= outside;
+		isFullOutside = isFullOutside && outside != 0;
+		isBehind = isBehind || primVPos[i].z < 0.0;
 	}
 
-	return isFullOutside;
+	return planes != 0 || (isFullOutside && isBehind);
 }
 
 //--------------------------------------------------------------------------------------
@@ -89,6 +114,12 @@ void ComputeAABB(float3x4 primVPos, out uint2 minTile,
 
 	minTile = max(minTile, 0);
 	maxTile = min(maxTile + 1, tileInfo.Dim);
+
+	// Scissor
+	uint2 minScissorTile, maxScissorTile;
+	GetScissorTiles(tileInfo.SizeLog, minScissorTile, maxScissorTile);
+	minTile = max(minTile, minScissorTile);
+	maxTile = min(maxTile, maxScissorTile);
 }
 
 //--------------------------------------------------------------------------------------
@@ -134,8 +165,9 @@ void AppendPrimitive(uint primId, uint tileY, inout uint3 scanLine,
 //--------------------------------------------------------------------------------------
 // Bin the primitive.
 //--------------------------------------------------------------------------------------
-void BinPrimitive(uint primId, uint tileDimX, RasterInfo rasterInfo)
+void BinPrimitive(uint primId, TileInfo tileInfo, RasterInfo rasterInfo)
 {
+	const uint tileDimX = tileInfo.Dim.x;
 	const float3 w = rasterInfo.w;
 	const float3x2 n = rasterInfo.n;
 	const float2 minPt = rasterInfo.MinPt;
@@ -177,7 +209,9 @@ void BinPrimitive(uint primId, uint tileDimX, RasterInfo rasterInfo)
 			for (uint j = scanLine.x; j < scanLine.y; ++j)
 			{
 				tile.x = j;
-				if (j > scanLine.x + 2 && j + 3 < scanLine.y && isInsideY)
+				// The pixels outside the scissor rectangle keep their depth
+				if (j > scanLine.x + 2 && j + 3 < scanLine.y && isInsideY &&
+					IsTileInsideScissor(tile, tileInfo.SizeLog))
 					InterlockedMin(uavInfo.rwHiZ[tile], zMax, hiZ);
 				else
 				{
@@ -187,7 +221,8 @@ void BinPrimitive(uint primId, uint tileDimX, RasterInfo rasterInfo)
 
 				if (hiZ < zMin)
 				{
-					// Depth Test failed for this tile
+					// Depth Test failed for this tile, the later loops retest it
+					if (k == 0) COUNT_EARLY_Z(EARLY_Z_TILE_PRIMS, scanLine.y - j);
 					scanLine.y = j;
 					break;
 				}
@@ -204,9 +239,9 @@ void BinPrimitive(uint primId, uint tileDimX, RasterInfo rasterInfo)
 bool GetTileInfo(float3x4 primVPos, out TileInfo tileInfo)
 {
 	const float area = determinant(primVPos[0].xy, primVPos[1].xy, primVPos[2].xy);
-	if (USE_TRIPPLE_RASTER && area > (TILE_SIZE * TILE_SIZE)* (4.0 * 4.0))
+	if (USE_TRIPPLE_RASTER && area > (TILE_SIZE * TILE_SIZE) * g_binThreshold)
 	{
-		// If the area > 4x4 tile sizes, the bin rasterization will be triggered.
+		// If the area > the threshold in tiles, the bin rasterization will be triggered.
 		tileInfo.SizeLog = BIN_SIZE_LOG;
 		tileInfo.Size = BIN_SIZE;
 		tileInfo.Dim = g_binDim;
@@ -238,6 +273,14 @@ void ProcessPrimitive(float3x4 primVPos, uint primId)
 	// Create the AABB.
 	ComputeAABB(primVPos, rasterInfo.MinTile, rasterInfo.MaxTile, tileInfo);
 
+#if MULTI_VIEW
+	// Scissor to the view, whose bin-aligned rectangle keeps the tiles of the views apart
+	const uint4 viewBins = g_viewBins[primId % g_numViews];
+	const uint binToTileLog = BIN_SIZE_LOG - tileInfo.SizeLog;
+	rasterInfo.MinTile = max(rasterInfo.MinTile, viewBins.xy << binToTileLog);
+	rasterInfo.MaxTile = min(rasterInfo.MaxTile, (viewBins.zw << binToTileLog) - 1);
+#endif
+
 	rasterInfo.ZMin = asuint(min(primVPos[0].z, min(primVPos[1].z, primVPos[2].z)));
 	rasterInfo.ZMax = asuint(max(primVPos[0].z, max(primVPos[1].z, primVPos[2].z)));
 
@@ -268,7 +311,7 @@ void ProcessPrimitive(float3x4 primVPos, uint primId)
 		rasterInfo.UavInfo.rwPrimCount = g_rwBinPrimCount;
 		rasterInfo.UavInfo.rwPrimitives = g_rwBinPrimitives;
 		rasterInfo.UavInfo.rwHiZ = g_rwBinZ;
-		BinPrimitive(primId, tileInfo.Dim.x, rasterInfo);
+		BinPrimitive(primId, tileInfo, rasterInfo);
 	}
 	else
 	{
@@ -276,7 +319,7 @@ void ProcessPrimitive(float3x4 primVPos, uint primId)
 		rasterInfo.UavInfo.rwPrimCount = g_rwTilePrimCount;
 		rasterInfo.UavInfo.rwPrimitives = g_rwTilePrimitives;
 		rasterInfo.UavInfo.rwHiZ = g_rwTileZ;
-		BinPrimitive(primId, tileInfo.Dim.x, rasterInfo);
+		BinPrimitive(primId, tileInfo, rasterInfo);
 	}
 }
 
@@ -399,9 +442,24 @@ void BinPrimitive2(float3x4 primVPos, uint primId)
 }
 #endif
 
-[numthreads(64, 1, 1)]
+[numthreads(CLUSTER_SIZE, 1, 1)]
+#if MULTI_VIEW
 void main(uint DTid : SV_DispatchThreadID)
+#else
+void main(uint GTid : SV_GroupThreadID, uint Gid : SV_GroupID)
+#endif
 {
+#if OCCLUSION_CULL > 1
+	// Only the clusters rejected by the first phase are retested
+	const uint clusterId = g_rwRejectedClusters[Gid];
+#elif !MULTI_VIEW
+	// Clusters are dispatched front to back, so that the occluders fill TileZ first
+	const uint clusterId = g_roClusterOrder[Gid];
+#endif
+#if !MULTI_VIEW
+	const uint DTid = clusterId * CLUSTER_SIZE + GTid;
+#endif
+
 	float3x4 primVPos;
 
 	// Load the vertex positions of the triangle
@@ -409,11 +467,32 @@ void main(uint DTid : SV_DispatchThreadID)
 	[unroll]
 	for (uint i = 0; i < 3; ++i) primVPos[i] = g_rwVertexPos[baseVIdx + i];
 
+#if OCCLUSION_CULL
+	// Cull the primitive, after the cluster test that the whole group has to reach.
+	const bool isOutside = CullPrimitive(primVPos);
+	ToScreenSpace(primVPos);
+	const bool isCulled = isOutside || CullScissor(primVPos);
+	const bool isVisible = IsClusterVisible(primVPos, isCulled, GTid, clusterId);
+#if OCCLUSION_CULL > 1
+	// The first phase has counted the primitives culled by the frustum and the scissor
+	CountStats(STATS_CULLED_OCCLUSION, !isCulled && !isVisible);
+#else
+	CountStats(STATS_CULLED_FRUSTUM, isOutside);
+	CountStats(STATS_CULLED_SCISSOR, isCulled && !isOutside);
+#endif
+	if (isCulled || !isVisible) return;
+#else
 	// Cull the primitive.
-	if (CullPrimitive(primVPos)) return;
+	const bool isOutside = CullPrimitive(primVPos);
+	CountStats(STATS_CULLED_FRUSTUM, isOutside);
+	if (isOutside) return;
 
 	// To screen space.
 	ToScreenSpace(primVPos);
+	const bool isScissored = CullScissor(primVPos);
+	CountStats(STATS_CULLED_SCISSOR, isScissored);
+	if (isScissored) return;
+#endif
 
 	// Store each successful clipping result.
 	ProcessPrimitive(primVPos, DTid);
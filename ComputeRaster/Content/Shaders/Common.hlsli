@@ -17,8 +17,10 @@ struct TilePrim
 cbuffer cb
 {
 	float4	g_viewport;	// X, Y, W, H
+	uint4	g_scissor;	// Left, top, right, bottom in pixels, clamped to the viewport
 	uint2	g_tileDim;
 	uint2	g_binDim;
+	float	g_binThreshold;	// Area in tiles above which the bin raster is used
 };
 
 //--------------------------------------------------------------------------------------
@@ -47,6 +49,49 @@ void ToScreenSpace(inout float3x4 primVPos)
 		primVPos[i] = ClipToScreen(primVPos[i]);
 }
 
+//--------------------------------------------------------------------------------------
+// Get the range of the tiles of the size overlapped by the non-empty scissor rectangle,
+// with the maximum inclusive.
+//--------------------------------------------------------------------------------------
+void GetScissorTiles(uint sizeLog, out uint2 minTile, out uint2 maxTile)
+{
+	minTile = g_scissor.xy >> sizeLog;
+	maxTile = (g_scissor.zw - 1) >> sizeLog;
+}
+
+//--------------------------------------------------------------------------------------
+// Cull a primitive in screen space to the scissor rectangle.
+//--------------------------------------------------------------------------------------
+bool CullScissor(float3x4 primVPos)
+{
+	const float2 minPt = min(primVPos[0].xy, min(primVPos[1].xy, primVPos[2].xy));
+	const float2 maxPt = max(primVPos[0].xy, max(primVPos[1].xy, primVPos[2].xy));
+
+	return any(g_scissor.xy >= g_scissor.zw) || any(maxPt < g_scissor.xy) || any(minPt >= g_scissor.zw);
+}
+
+//--------------------------------------------------------------------------------------
+// Check if the tile of the size is overlapped by the scissor rectangle.
+//--------------------------------------------------------------------------------------
+bool IsTileInScissor(uint2 tile, uint sizeLog)
+{
+	const uint2 minPt = tile << sizeLog;
+	const uint2 maxPt = minPt + (1 << sizeLog);
+
+	return all(maxPt > g_scissor.xy && minPt < g_scissor.zw);
+}
+
+//--------------------------------------------------------------------------------------
+// Check if the tile of the size is fully inside the scissor rectangle.
+//--------------------------------------------------------------------------------------
+bool IsTileInsideScissor(uint2 tile, uint sizeLog)
+{
+	const uint2 minPt = tile << sizeLog;
+	const uint2 maxPt = minPt + (1 << sizeLog);
+
+	return all(minPt >= g_scissor.xy && maxPt <= g_scissor.zw);
+}
+
 //--------------------------------------------------------------------------------------
 // Determinant
 //--------------------------------------------------------------------------------------
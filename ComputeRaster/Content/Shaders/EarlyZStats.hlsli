@@ -0,0 +1,23 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Counters of the work rejected by the depth early-outs, enabled by EARLY_Z_STATS in
+// SharedConst.h and read back by SoftGraphicsPipeline::GetEarlyZStats().
+//--------------------------------------------------------------------------------------
+#define EARLY_Z_TILE_PRIMS	0	// Tile and bin primitives rejected by TileZ and BinZ
+#define EARLY_Z_PIXELS		1	// Pixels rejected by the depth test
+
+#if EARLY_Z_STATS || PIPELINE_STATS
+//--------------------------------------------------------------------------------------
+// UAV buffers
+//--------------------------------------------------------------------------------------
+RWStructuredBuffer<uint> g_rwStatCounters : register (u0, space2);
+#endif
+
+#if EARLY_Z_STATS
+#define COUNT_EARLY_Z(stat, n) InterlockedAdd(g_rwStatCounters[stat], n)
+#else
+#define COUNT_EARLY_Z(stat, n)
+#endif
@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Generate up to 4 levels of the max-depth Hi-Z pyramid per pass. Each thread reduces
+// a 2x2 quad of the source into the first level, and the thread group reduces its 8x8
+// texels further in the group-shared memory, so the source is read only once.
+// Out-of-bounds loads return 0, which never raises the maximum of a depth in [0, 1].
+//--------------------------------------------------------------------------------------
+#define GROUP_SIZE_LOG	3
+#define GROUP_SIZE		(1 << GROUP_SIZE_LOG)
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cb
+{
+	uint g_numLevels;	// Levels to generate in this pass
+};
+
+//--------------------------------------------------------------------------------------
+// UAV buffers
+//--------------------------------------------------------------------------------------
+RWTexture2D<uint> g_rwSrc;
+RWTexture2D<uint> g_rwHiZ0;
+RWTexture2D<uint> g_rwHiZ1;
+RWTexture2D<uint> g_rwHiZ2;
+RWTexture2D<uint> g_rwHiZ3;
+
+groupshared uint g_depths[GROUP_SIZE * GROUP_SIZE];
+
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void main(uint2 DTid : SV_DispatchThreadID, uint2 GTid : SV_GroupThreadID, uint2 Gid : SV_GroupID)
+{
+	// Depths in [0, 1] order like their bits
+	const uint2 srcPos = DTid << 1;
+	uint z = max(max(g_rwSrc[srcPos], g_rwSrc[srcPos + uint2(1, 0)]),
+		max(g_rwSrc[srcPos + uint2(0, 1)], g_rwSrc[srcPos + 1]));
+	g_rwHiZ0[DTid] = z;
+	g_depths[GROUP_SIZE * GTid.y + GTid.x] = z;
+
+	[unroll]
+	for (uint i = 1; i <= GROUP_SIZE_LOG; ++i)
+	{
+		const uint size = GROUP_SIZE >> i;
+		const bool isActive = all(GTid < size);
+
+		GroupMemoryBarrierWithGroupSync();
+		if (isActive)
+		{
+			const uint idx = GROUP_SIZE * (GTid.y << 1) + (GTid.x << 1);
+			z = max(max(g_depths[idx], g_depths[idx + 1]),
+				max(g_depths[idx + GROUP_SIZE], g_depths[idx + GROUP_SIZE + 1]));
+		}
+
+		GroupMemoryBarrierWithGroupSync();
+		if (isActive)
+		{
+			g_depths[GROUP_SIZE * GTid.y + GTid.x] = z;
+
+			const uint2 dstPos = Gid * size + GTid;
+			if (i < g_numLevels)
+			{
+				if (i == 1) g_rwHiZ1[dstPos] = z;
+				else if (i == 2) g_rwHiZ2[dstPos] = z;
+				else g_rwHiZ3[dstPos] = z;
+			}
+		}
+	}
+}
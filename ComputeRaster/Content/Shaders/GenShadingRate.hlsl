@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Derive the coarse shading rate of each tile from the curvature of its depth. The
+// depth is linear in screen space on planes, so its second differences vanish there,
+// and grow with the curvature of the surfaces and at their silhouettes. The rate is
+// the log2 of the coarse block size: 2 (4x4) below a quarter of the threshold, 1 (2x2)
+// below the threshold, and 0 (1x1) otherwise.
+//--------------------------------------------------------------------------------------
+#include "SharedConst.h"
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cb
+{
+	float g_threshold;	// Curvature of the depth above which the tile is shaded per pixel
+};
+
+//--------------------------------------------------------------------------------------
+// UAV buffers
+//--------------------------------------------------------------------------------------
+RWTexture2D<uint> g_rwDepth;
+RWTexture2D<uint> g_rwShadingRate;
+
+groupshared uint g_curvature;
+
+//--------------------------------------------------------------------------------------
+// Load the depth at the clamped position.
+//--------------------------------------------------------------------------------------
+float LoadDepth(int2 pos, int2 maxPos)
+{
+	return asfloat(g_rwDepth[clamp(pos, 0, maxPos)]);
+}
+
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void main(uint2 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint2 Gid : SV_GroupID)
+{
+	if (GTidx == 0) g_curvature = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	uint2 dim;
+	g_rwDepth.GetDimensions(dim.x, dim.y);
+	const int2 maxPos = dim - 1;
+	const int2 pos = min(DTid, maxPos);
+
+	// The cleared pixels are not shaded
+	const float z = LoadDepth(pos, maxPos);
+	if (z < 1.0)
+	{
+		const float2 z0 = float2(LoadDepth(pos - int2(1, 0), maxPos), LoadDepth(pos - int2(0, 1), maxPos));
+		const float2 z1 = float2(LoadDepth(pos + int2(1, 0), maxPos), LoadDepth(pos + int2(0, 1), maxPos));
+		const float2 d2 = abs(z0 + z1 - 2.0 * z);
+
+		// The bits of non-negative floats are ordered as uints
+		InterlockedMax(g_curvature, asuint(d2.x + d2.y));
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (GTidx == 0)
+	{
+		const float curvature = asfloat(g_curvature);
+		g_rwShadingRate[Gid] = curvature < g_threshold * 0.25 ? 2 : (curvature < g_threshold ? 1 : 0);
+	}
+}
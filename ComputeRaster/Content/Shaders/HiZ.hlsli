@@ -0,0 +1,21 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Test an inclusive rectangle of pixels against the max-depth Hi-Z pyramid, whose level
+// i holds the maximum depth of 2^(i+1) x 2^(i+1) pixels. The level is the finest one at
+// which the rectangle covers no more than 2x2 texels, so the test takes 4 loads.
+//--------------------------------------------------------------------------------------
+bool IsOccludedHiZ(Texture2D<uint> hiZ, uint4 rect, uint zMin)
+{
+	const uint2 span = rect.zw - rect.xy;
+	const uint maxSpan = max(span.x, span.y);
+	const uint level = maxSpan > 1 ? firstbithigh(maxSpan) : 0;
+
+	const uint4 texels = rect >> (level + 1);
+	const uint z = max(max(hiZ.Load(uint3(texels.xy, level)), hiZ.Load(uint3(texels.zy, level))),
+		max(hiZ.Load(uint3(texels.xw, level)), hiZ.Load(uint3(texels.zw, level))));
+
+	return z < zMin;
+}
@@ -0,0 +1,14 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Constant buffer of the views of a multi-view pass, in a space of its own so that it
+// never collides with the bindings of the user shaders
+//--------------------------------------------------------------------------------------
+cbuffer cbViews : register (b0, space1)
+{
+	matrix	g_viewProjs[MAX_VIEWS];	// Mapped to the rectangles of the views in the atlas
+	uint4	g_viewBins[MAX_VIEWS];	// Min bin and max bin (exclusive) of each view
+	uint	g_numViews;
+};
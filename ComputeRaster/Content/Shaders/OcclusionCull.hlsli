@@ -0,0 +1,141 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Two-phase occlusion culling of clusters, each of which is the CLUSTER_SIZE primitives
+// of a thread group of the bin raster.
+// OCCLUSION_CULL == 1: tests the clusters against the Hi-Z of the previous frame, and
+// records the rejected clusters.
+// OCCLUSION_CULL == 2: retests the rejected clusters against the Hi-Z of this frame.
+// The Hi-Z pyramid is regenerated from PixelZ between the phases.
+//--------------------------------------------------------------------------------------
+#include "HiZ.hlsli"
+
+#define CLUSTER_NONEMPTY	0x1
+#define CLUSTER_UNBOUNDED	0x2
+#define CLUSTER_OCCLUDED	0x4
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbCull : register (b0, space1)
+{
+	matrix g_reprojection;	// From the clip space of this frame to that of the previous frame
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+Texture2D<uint> g_roHiZ : register (t0, space1);
+
+//--------------------------------------------------------------------------------------
+// UAV buffers
+//--------------------------------------------------------------------------------------
+RWStructuredBuffer<uint> g_rwRejectedClusters : register (u0, space1);
+RWStructuredBuffer<uint> g_rwRejectedCount : register (u1, space1);
+
+groupshared uint g_clusterBounds[6];	// Min x, min y, max x, max y, min z, and max z
+groupshared uint g_clusterFlags;
+
+//--------------------------------------------------------------------------------------
+// Reproject the screen-space bounds into the previous frame.
+//--------------------------------------------------------------------------------------
+bool Reproject(inout float4 rect, inout float zMin, float zMax)
+{
+	float4 prevRect = float4(3.402823466e+38.xx, -3.402823466e+38.xx);
+	float prevZMin = 1.0;
+
+	[unroll]
+	for (uint i = 0; i < 8; ++i)
+	{
+		float4 pos;
+		pos.x = i & 1 ? rect.z : rect.x;
+		pos.y = i & 2 ? rect.w : rect.y;
+		pos.z = i & 4 ? zMax : zMin;
+		pos.w = 1.0;
+		pos.xy = pos.xy / g_viewport.zw * float2(2.0, -2.0) + float2(-1.0, 1.0);
+		pos = mul(pos, g_reprojection);
+		if (pos.w <= 0.0) return false;
+
+		pos = ClipToScreen(pos);
+		prevRect.xy = min(prevRect.xy, pos.xy);
+		prevRect.zw = max(prevRect.zw, pos.xy);
+		prevZMin = min(prevZMin, pos.z);
+	}
+
+	// The previous frame has no depth outside the screen
+	if (any(prevRect.xy < 0.0) || any(prevRect.zw > g_viewport.zw)) return false;
+
+	rect = prevRect;
+	zMin = max(prevZMin, 0.0);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Test the cluster of the thread group against the Hi-Z. All the threads of the group
+// must call it, as it synchronizes the group.
+//--------------------------------------------------------------------------------------
+bool IsClusterVisible(float3x4 primVPos, bool isCulled, uint GTid, uint clusterId)
+{
+	if (GTid == 0)
+	{
+		g_clusterBounds[0] = g_clusterBounds[1] = g_clusterBounds[4] = 0xffffffff;
+		g_clusterBounds[2] = g_clusterBounds[3] = g_clusterBounds[5] = 0;
+		g_clusterFlags = 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (!isCulled)
+	{
+		// Primitives crossing the eye plane have no bounded screen extents
+		if (any(float3(primVPos[0].w, primVPos[1].w, primVPos[2].w) <= 0.0))
+			InterlockedOr(g_clusterFlags, CLUSTER_UNBOUNDED);
+
+		// Non-negative floats order like their bits
+		const float2 minPt = clamp(min(primVPos[0].xy, min(primVPos[1].xy, primVPos[2].xy)), 0.0, g_viewport.zw);
+		const float2 maxPt = clamp(max(primVPos[0].xy, max(primVPos[1].xy, primVPos[2].xy)), 0.0, g_viewport.zw);
+		const float zMin = saturate(min(primVPos[0].z, min(primVPos[1].z, primVPos[2].z)));
+		const float zMax = saturate(max(primVPos[0].z, max(primVPos[1].z, primVPos[2].z)));
+		InterlockedMin(g_clusterBounds[0], asuint(minPt.x));
+		InterlockedMin(g_clusterBounds[1], asuint(minPt.y));
+		InterlockedMax(g_clusterBounds[2], asuint(maxPt.x));
+		InterlockedMax(g_clusterBounds[3], asuint(maxPt.y));
+		InterlockedMin(g_clusterBounds[4], asuint(zMin));
+		InterlockedMax(g_clusterBounds[5], asuint(zMax));
+		InterlockedOr(g_clusterFlags, CLUSTER_NONEMPTY);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (GTid == 0 && g_clusterFlags == CLUSTER_NONEMPTY)
+	{
+		float4 rect = float4(asfloat(g_clusterBounds[0]), asfloat(g_clusterBounds[1]),
+			asfloat(g_clusterBounds[2]), asfloat(g_clusterBounds[3]));
+		float zMin = asfloat(g_clusterBounds[4]);
+
+		bool isOccluded = true;
+#if OCCLUSION_CULL == 1
+		isOccluded = Reproject(rect, zMin, asfloat(g_clusterBounds[5]));
+#endif
+		if (isOccluded)
+		{
+			const uint4 pixels = min(uint4(rect), uint2(g_viewport.zw - 1.0).xyxy);
+			isOccluded = IsOccludedHiZ(g_roHiZ, pixels, asuint(zMin));
+		}
+
+		if (isOccluded)
+		{
+#if OCCLUSION_CULL == 1
+			// Record the cluster for the retest against the Hi-Z of this frame
+			uint idx;
+			InterlockedAdd(g_rwRejectedCount[0], 1, idx);
+			g_rwRejectedClusters[idx] = clusterId;
+#endif
+			g_clusterFlags |= CLUSTER_OCCLUDED;
+		}
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	return (g_clusterFlags & CLUSTER_OCCLUDED) == 0;
+}
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Counters of the work of the raster stages, enabled by PIPELINE_STATS in SharedConst.h
+// and read back by SoftGraphicsPipeline::GetPipelineStats(). They follow the early-Z
+// counters in the same buffer, so EarlyZStats.hlsli has to be included first.
+//--------------------------------------------------------------------------------------
+#define STATS_TRIANGLES_IN		2	// Counted on the CPU
+#define STATS_CULLED_FRUSTUM	3
+#define STATS_CULLED_SCISSOR	4
+#define STATS_CULLED_OCCLUSION	5	// By the retest of the cluster culling
+#define STATS_BIN_PRIMS			6
+#define STATS_TILE_PRIMS		7
+#define STATS_PIXELS_TESTED		8	// Covered pixels reaching the depth test
+#define STATS_PIXELS_PASSED		9
+#define STATS_PIXELS_SHADED		10
+
+#if PIPELINE_STATS
+// Tested, passed, and shaded pixels of the group, in 10 bits each
+groupshared uint g_pixelStats;
+
+//--------------------------------------------------------------------------------------
+// Count the lanes of the wave, for which the condition holds.
+//--------------------------------------------------------------------------------------
+void CountStats(uint stat, bool isCounted)
+{
+#if SHADER_MODEL >= 6
+	// One atomic per wave
+	const uint count = WaveActiveCountBits(isCounted);
+	if (WaveIsFirstLane() && count > 0) InterlockedAdd(g_rwStatCounters[stat], count);
+#else
+	if (isCounted) InterlockedAdd(g_rwStatCounters[stat], 1);
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// Count the primitive of the group, which is a bin or a tile primitive.
+//--------------------------------------------------------------------------------------
+void CountGroupPrim(uint stat, uint GTidx)
+{
+	if (GTidx == 0) InterlockedAdd(g_rwStatCounters[stat], 1);
+}
+
+//--------------------------------------------------------------------------------------
+// Reset the pixel counters of the group.
+//--------------------------------------------------------------------------------------
+void BeginPixelStats(uint GTidx)
+{
+	if (GTidx == 0) g_pixelStats = 0;
+	GroupMemoryBarrierWithGroupSync();
+}
+
+//--------------------------------------------------------------------------------------
+// Sum the pixel counters in the group, so that each group adds to the buffer once.
+// It has to be reached by all the threads of the group.
+//--------------------------------------------------------------------------------------
+void CountPixelStats(uint GTidx, bool isTested, bool isPassed, bool isShaded)
+{
+	const uint stats = (isTested ? 1 : 0) | (isPassed ? (1 << 10) : 0) | (isShaded ? (1 << 20) : 0);
+	if (stats) InterlockedAdd(g_pixelStats, stats);
+	GroupMemoryBarrierWithGroupSync();
+
+	if (GTidx == 0)
+	{
+		InterlockedAdd(g_rwStatCounters[STATS_TILE_PRIMS], 1);
+		if (g_pixelStats)
+		{
+			InterlockedAdd(g_rwStatCounters[STATS_PIXELS_TESTED], g_pixelStats & 0x3ff);
+			InterlockedAdd(g_rwStatCounters[STATS_PIXELS_PASSED], (g_pixelStats >> 10) & 0x3ff);
+			InterlockedAdd(g_rwStatCounters[STATS_PIXELS_SHADED], g_pixelStats >> 20);
+		}
+	}
+}
+#else
+#define CountStats(stat, isCounted)
+#define CountGroupPrim(stat, GTidx)
+#define BeginPixelStats(GTidx)
+#define CountPixelStats(GTidx, isTested, isPassed, isShaded)
+#endif
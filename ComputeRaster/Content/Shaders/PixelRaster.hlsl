@@ -7,6 +7,8 @@
 #include "PixelShader.hlsl"
 #undef main
 #include "Common.hlsli"
+#include "EarlyZStats.hlsli"
+#include "PipelineStats.hlsli"
 
 #define CR_PRIMITIVE_VERTEX_ATTRIBUTE_TYPE(t, c) t##3x##c
 #define CR_ATTRIBUTE_GEN_TYPE(t, c) t##c
@@ -37,60 +39,89 @@
 #define DEFINED_TARGET(n) (defined(CR_TARGET_TYPE##n) && defined(CR_TARGET##n))
 #define DECLARE_TARGET(n) RWTexture2D<CR_TARGET_TYPE##n> g_rwRenderTarget##n
 
+#ifndef CR_OUT_STRUCT_TYPE
+#define CR_OUT_STRUCT_TYPE CR_TARGET_TYPE0
+#endif
+
 #define USE_MUTEX 1
 
+#if TEMPORAL_CACHE
+#include "TemporalCache.hlsli"
+#endif
+
 //--------------------------------------------------------------------------------------
 // Buffers
 //--------------------------------------------------------------------------------------
 StructuredBuffer<TilePrim> g_roTilePrimitives;
+#if !DEPTH_ONLY
 #include "DeclareAttributes.hlsli"
+#endif
+#if COARSE_SHADING
+Texture2D<uint> g_roShadingRate : register (t0, space1);	// Log2 of the coarse block size per tile
+#endif
 
 //--------------------------------------------------------------------------------------
 // UAV buffers
 //--------------------------------------------------------------------------------------
 RWStructuredBuffer<float4> g_rwVertexPos;
+#if !DEPTH_ONLY
 #include "DeclareTargets.hlsli"
+#endif
 
+#if !DEPTH_EQUAL
 globallycoherent
+#endif
 RWTexture2D<uint> g_rwDepth;
 RWTexture2D<uint> g_rwHiZ;
 
-[numthreads(8, 8, 1)]
-void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx : SV_GroupIndex)
-{
-	const TilePrim tilePrim = g_roTilePrimitives[Gid];
-	const uint2 tile = uint2(tilePrim.TileIdx % g_tileDim.x, tilePrim.TileIdx / g_tileDim.x);
-
-	float3x4 primVPos;
-
-	// Load the vertex positions of the triangle
-	const uint baseVIdx = tilePrim.PrimId * 3;
-	[unroll]
-	for (uint i = 0; i < 3; ++i) primVPos[i] = g_rwVertexPos[baseVIdx + i];
+#if COARSE_SHADING
+groupshared uint g_blockShaders[TILE_SIZE * TILE_SIZE];	// The first shaded pixel of each coarse block
+groupshared CR_OUT_STRUCT_TYPE g_blockOutputs[TILE_SIZE * TILE_SIZE];
+#endif
 
-	// To screen space.
-	ToScreenSpace(primVPos);
+//--------------------------------------------------------------------------------------
+// Test the coverage and the depth of the pixel, and return whether it is to be shaded.
+//--------------------------------------------------------------------------------------
+bool RasterPixel(float3x4 primVPos, uint2 tile, uint2 pixelPos, out PSIn input, out float3 w, out uint depth)
+{
+	input = (PSIn)0;
+	w = 0.0;
+	depth = 0xffffffff;
 
 #if RE_HI_Z
 	const uint zMin = asuint(min(primVPos[0].z, min(primVPos[1].z, primVPos[2].z)));
-	if (g_rwHiZ[tile] < zMin) return;
+	if (g_rwHiZ[tile] < zMin) return false;
 #endif
 
-	PSIn input;
-	float3 w;
-	const uint2 pixelPos = (tile << TILE_SIZE_LOG) + GTid;
+	if (any(pixelPos < g_scissor.xy) || any(pixelPos >= g_scissor.zw)) return false;
+
 	input.Pos.xy = pixelPos + 0.5;
-	if (!Overlap(input.Pos.xy, (float3x2)primVPos, w)) return;
+	if (!Overlap(input.Pos.xy, (float3x2)primVPos, w)) return false;
 
 	// Normalize barycentric coordinates.
 	const float area = determinant(primVPos[0].xy, primVPos[1].xy, primVPos[2].xy);
-	if (area <= 0.0) return;
+	if (area <= 0.0) return false;
 	w /= area;
 
 	// Depth test
-	uint depthMin;
-	input.Pos.z = w.x * primVPos[0].z + w.y * primVPos[1].z + w.z * primVPos[2].z;
-	const uint depth = asuint(input.Pos.z);
+	// The depth must be bit-exact between the depth-only and the equal-depth passes
+	precise const float z = w.x * primVPos[0].z + w.y * primVPos[1].z + w.z * primVPos[2].z;
+	input.Pos.z = z;
+	depth = asuint(z);
+#if DEPTH_ONLY
+	InterlockedMin(g_rwDepth[pixelPos], depth);
+
+	return false;
+#elif DEPTH_EQUAL
+	// The depth buffer is complete after the depth-only pass, so only the nearest
+	// primitive of each pixel passes, and the depth needs no atomic updates.
+	if (depth != g_rwDepth[pixelPos])
+	{
+		COUNT_EARLY_Z(EARLY_Z_PIXELS, 1);
+		return false;
+	}
+#else
+	uint i, depthMin;
 #if USE_MUTEX > 1
 	// Mutual exclusive writing
 	[allow_uav_condition]
@@ -104,7 +135,23 @@ void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx :
 #else
 	InterlockedMin(g_rwDepth[pixelPos], depth, depthMin);
 #endif
-	if (depth > depthMin) return;
+	if (depth > depthMin)
+	{
+		COUNT_EARLY_Z(EARLY_Z_PIXELS, 1);
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+#if !DEPTH_ONLY
+//--------------------------------------------------------------------------------------
+// Interpolate the attributes at the pixel, and call the pixel shader.
+//--------------------------------------------------------------------------------------
+CR_OUT_STRUCT_TYPE Shade(float3x4 primVPos, uint baseVIdx, float3 w, PSIn input)
+{
+	uint i;
 
 	// Interpolations
 	float3 persp = float3(w.x * primVPos[0].w, w.y * primVPos[1].w, w.z * primVPos[2].w);
@@ -114,13 +161,74 @@ void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx :
 #include "SetAttributes.hlsli"
 
 	// Call pixel shader
-#ifndef CR_OUT_STRUCT_TYPE
-#define CR_OUT_STRUCT_TYPE CR_TARGET_TYPE0
+	return PSMain(input);
+}
 #endif
-	CR_OUT_STRUCT_TYPE output = PSMain(input);
 
-#if USE_MUTEX
+[numthreads(8, 8, 1)]
+void main(uint2 GTid : SV_GroupThreadID, uint GTidx : SV_GroupIndex, uint Gid : SV_GroupID)
+{
+	const TilePrim tilePrim = g_roTilePrimitives[Gid];
+	const uint2 tile = uint2(tilePrim.TileIdx % g_tileDim.x, tilePrim.TileIdx / g_tileDim.x);
+
+	float3x4 primVPos;
+
+	// Load the vertex positions of the triangle
+	const uint baseVIdx = tilePrim.PrimId * 3;
+	[unroll]
+	for (uint i = 0; i < 3; ++i) primVPos[i] = g_rwVertexPos[baseVIdx + i];
+
+	// To screen space.
+	ToScreenSpace(primVPos);
+	BeginPixelStats(GTidx);
+
+#if COARSE_SHADING
+	// The pixels of each coarse block of the tile share the shading of one pixel
+	const uint rateLog = min(g_roShadingRate[tile], 2);
+	const uint block = ((GTid.y >> rateLog) << (TILE_SIZE_LOG - rateLog)) + (GTid.x >> rateLog);
+	g_blockShaders[GTidx] = 0xffffffff;
+	GroupMemoryBarrierWithGroupSync();
+#endif
+
+	PSIn input;
+	float3 w;
+	uint depth;
+	const uint2 pixelPos = (tile << TILE_SIZE_LOG) + GTid;
+	const bool isShaded = RasterPixel(primVPos, tile, pixelPos, input, w, depth);
+	const bool isTested = depth != 0xffffffff;
+
+#if DEPTH_ONLY
+	// Whether the depth passes is unknown until the pass completes
+	CountPixelStats(GTidx, isTested, false, false);
+#else
+#if COARSE_SHADING
+	// The first shaded pixel of each block shades it, while depth stays per pixel
+	if (isShaded) InterlockedMin(g_blockShaders[block], GTidx);
+	GroupMemoryBarrierWithGroupSync();
+	const bool isBlockShader = g_blockShaders[block] == GTidx;
+	if (isBlockShader) g_blockOutputs[block] = Shade(primVPos, baseVIdx, w, input);
+	CountPixelStats(GTidx, isTested, isShaded, isBlockShader);
+	GroupMemoryBarrierWithGroupSync();
+	if (!isShaded) return;
+	const CR_OUT_STRUCT_TYPE output = g_blockOutputs[block];
+#elif TEMPORAL_CACHE
+	CR_OUT_STRUCT_TYPE output;
+	bool isReused = false;
+	if (isShaded) isReused = LookupCache(pixelPos, depth, tilePrim.PrimId, output);
+	CountPixelStats(GTidx, isTested, isShaded, isShaded && !isReused);
+	if (!isShaded) return;
+	if (!isReused) output = Shade(primVPos, baseVIdx, w, input);
+#else
+	CountPixelStats(GTidx, isTested, isShaded, isShaded);
+	if (!isShaded) return;
+	const CR_OUT_STRUCT_TYPE output = Shade(primVPos, baseVIdx, w, input);
+#endif
+
+#if DEPTH_EQUAL
+#include "SetTargets.hlsli"
+#elif USE_MUTEX
 	// Mutual exclusive writing
+	uint depthMin;
 	[allow_uav_condition]
 	for (i = 0, depthMin = 0xffffffff; i < 0xffffffff && depthMin == 0xffffffff; ++i)
 	{
@@ -144,4 +252,5 @@ void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx :
 #include "SetTargets.hlsli"
 	}
 #endif
+#endif // DEPTH_ONLY
 }
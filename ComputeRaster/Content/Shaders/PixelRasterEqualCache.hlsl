@@ -0,0 +1,7 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define DEPTH_EQUAL 1
+#define TEMPORAL_CACHE 1
+#include "PixelRaster.hlsl"
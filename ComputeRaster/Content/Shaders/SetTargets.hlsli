@@ -35,3 +35,7 @@ SET_TARGET(6);
 #if DEFINED_TARGET(7)
 SET_TARGET(7);
 #endif
+
+#if TEMPORAL_CACHE
+g_rwPrimitiveId[pixelPos] = GetCachePrimId(tilePrim.PrimId);
+#endif
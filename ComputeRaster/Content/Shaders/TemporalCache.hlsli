@@ -0,0 +1,90 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Temporal reprojection cache of the shading: each pixel is reprojected into the
+// previous frame, and reuses the color there if the same primitive covered it at the
+// reprojected depth. The history is copied from the targets at the end of each frame by
+// SoftGraphicsPipeline::UpdateTemporalCache(). A rotating subset of the pixels is shaded
+// regardless, so that the reused shading cannot go stale for more than a refresh period.
+//--------------------------------------------------------------------------------------
+#if DEFINED_TARGET(0)
+#error The temporal cache reuses the color of target 0, which must be the output of the pixel shader
+#endif
+
+#define TEMPORAL_CACHE_REUSED	0	// Pixels of which the shading was reused
+#define TEMPORAL_CACHE_SHADED	1	// Pixels shaded on misses and refreshes
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbCache : register (b0, space3)
+{
+	matrix g_cacheReprojection;	// From the clip space of this frame to that of the previous frame
+	uint g_refreshPeriod;		// Every pixel is reshaded at least once in this number of frames
+	uint g_cacheFrameIdx;
+	float g_depthTolerance;
+	uint g_cacheDrawIdx;		// Within the frame
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+Texture2D<CR_TARGET_TYPE0> g_roHistoryColor : register (t0, space3);
+Texture2D<uint> g_roHistoryDepth : register (t1, space3);
+Texture2D<uint> g_roHistoryPrimId : register (t2, space3);
+
+//--------------------------------------------------------------------------------------
+// UAV buffers
+//--------------------------------------------------------------------------------------
+RWTexture2D<uint> g_rwPrimitiveId : register (u0, space3);
+RWStructuredBuffer<uint> g_rwCacheStats : register (u1, space3);
+
+//--------------------------------------------------------------------------------------
+// Get the ID of the primitive in the cache, which also tells the draws apart, as the
+// primitive IDs restart from 0 in each draw.
+//--------------------------------------------------------------------------------------
+uint GetCachePrimId(uint primId)
+{
+	return (g_cacheDrawIdx << CACHE_DRAW_ID_SHIFT) | primId;
+}
+
+//--------------------------------------------------------------------------------------
+// Look up the shading of the pixel in the previous frame, and return whether it hits.
+//--------------------------------------------------------------------------------------
+bool LookupCache(uint2 pixelPos, uint depth, uint primId, out CR_TARGET_TYPE0 color)
+{
+	color = (CR_TARGET_TYPE0)0;
+
+	// Interleave the refreshes, so that neighboring pixels refresh in different frames
+	bool isHit = (pixelPos.x * 7 + pixelPos.y * 3 + g_cacheFrameIdx) % g_refreshPeriod != 0;
+
+	if (isHit)
+	{
+		float4 pos;
+		pos.xy = (pixelPos + 0.5) / g_viewport.zw * float2(2.0, -2.0) + float2(-1.0, 1.0);
+		pos.z = asfloat(depth);
+		pos.w = 1.0;
+		pos = mul(pos, g_cacheReprojection);
+		isHit = pos.w > 0.0;
+
+		if (isHit)
+		{
+			pos = ClipToScreen(pos);
+			isHit = all(pos.xy >= 0.0) && all(pos.xy < g_viewport.zw);
+		}
+
+		if (isHit)
+		{
+			const uint2 prevPos = pos.xy;
+			isHit = g_roHistoryPrimId[prevPos] == GetCachePrimId(primId) &&
+				abs(asfloat(g_roHistoryDepth[prevPos]) - pos.z) <= g_depthTolerance;
+			if (isHit) color = g_roHistoryColor[prevPos];
+		}
+	}
+
+	InterlockedAdd(g_rwCacheStats[isHit ? TEMPORAL_CACHE_REUSED : TEMPORAL_CACHE_SHADED], 1);
+
+	return isHit;
+}
@@ -4,6 +4,8 @@
 
 #include "SharedConst.h"
 #include "Common.hlsli"
+#include "EarlyZStats.hlsli"
+#include "PipelineStats.hlsli"
 
 //--------------------------------------------------------------------------------------
 // Buffers
@@ -22,8 +24,10 @@ RWTexture2D<uint> g_rwTileZ;
 RWTexture2D<uint> g_rwHiZ;
 
 [numthreads(8, 8, 1)]
-void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx : SV_GroupIndex)
+void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID, uint GTidx : SV_GroupIndex)
 {
+	CountGroupPrim(STATS_BIN_PRIMS, GTidx);
+
 	TilePrim tilePrim = g_roBinPrimitives[Gid];
 	const uint2 bin = uint2(tilePrim.TileIdx % g_binDim.x, tilePrim.TileIdx / g_binDim.x);
 
@@ -50,6 +54,8 @@ void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx :
 
 	float3 w;
 	const uint2 tile = (bin << TILE_TO_BIN_LOG) + GTid;
+	if (!IsTileInScissor(tile, TILE_SIZE_LOG)) return;
+
 	const float2 pos = tile + 0.5;
 	if (!Overlap(pos, sv, w)) return;
 
@@ -65,7 +71,8 @@ void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx :
 	sv = Scale(v, -0.5);
 	
 	uint tileZ;
-	if (area >= 2.0 && Overlap(pos, sv, w))
+	// The pixels outside the scissor rectangle keep their depth
+	if (area >= 2.0 && Overlap(pos, sv, w) && IsTileInsideScissor(tile, TILE_SIZE_LOG))
 		InterlockedMin(g_rwTileZ[tile], zMax, tileZ);
 	else
 	{
@@ -73,7 +80,11 @@ void main(uint2 GTid : SV_GroupThreadID, uint Gid : SV_GroupID)//, uint GTidx :
 		tileZ = g_rwTileZ[tile];
 	}
 
-	if (tileZ < zMin) return;
+	if (tileZ < zMin)
+	{
+		COUNT_EARLY_Z(EARLY_Z_TILE_PRIMS, 1);
+		return;
+	}
 #endif
 
 	tilePrim.TileIdx = g_tileDim.x * tile.y + tile.x;
@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Upscale the rendered sub-rectangle at the top-left of the source to the whole output
+// with bilinear filtering. The texels are loaded and clamped to the sub-rectangle, so
+// that the stale texels outside it never bleed into the edges.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cb
+{
+	float2 g_srcSize;	// Size of the rendered sub-rectangle
+};
+
+//--------------------------------------------------------------------------------------
+// Texture
+//--------------------------------------------------------------------------------------
+Texture2D<float4> g_txSource;
+
+//--------------------------------------------------------------------------------------
+// UAV buffer
+//--------------------------------------------------------------------------------------
+RWTexture2D<float4> g_rwOutput;
+
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+	float2 dim;
+	g_rwOutput.GetDimensions(dim.x, dim.y);
+	if (any(DTid >= uint2(dim))) return;
+
+	const float2 pos = (DTid + 0.5) * g_srcSize / dim - 0.5;
+	const float2 w = frac(pos);
+	const int2 maxPos = int2(g_srcSize) - 1;
+	const int2 pos0 = clamp(int2(floor(pos)), 0, maxPos);
+	const int2 pos1 = min(pos0 + 1, maxPos);
+
+	const float4 c00 = g_txSource[pos0];
+	const float4 c10 = g_txSource[int2(pos1.x, pos0.y)];
+	const float4 c01 = g_txSource[int2(pos0.x, pos1.y)];
+	const float4 c11 = g_txSource[pos1];
+
+	g_rwOutput[DTid] = lerp(lerp(c00, c10, w.x), lerp(c01, c11, w.x), w.y);
+}
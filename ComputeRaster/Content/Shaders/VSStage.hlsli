@@ -6,6 +6,11 @@
 #include "VertexShader.hlsl"
 #undef main
 
+#if MULTI_VIEW
+#include "SharedConst.h"
+#include "MultiView.hlsli"
+#endif
+
 #define CR_ATTRIBUTE_GEN_TYPE(t, c) t##c
 #define CR_ATTRIBUTE_TYPE(n) CR_ATTRIBUTE_GEN_TYPE(CR_ATTRIBUTE_BASE_TYPE##n, CR_ATTRIBUTE_COMPONENT_COUNT##n)
 
@@ -24,7 +29,9 @@ Buffer<uint> g_roIndexBuffer;
 // UAV buffers
 //--------------------------------------------------------------------------------------
 RWStructuredBuffer<float4> g_rwVertexPos;
+#if !DEPTH_ONLY
 #include "DeclareAttributes.hlsli"
+#endif
 
 //--------------------------------------------------------------------------------------
 // Fetch shader
@@ -43,7 +50,18 @@ void main(uint DTid : SV_DispatchThreadID)
 	// Call vertex shader
 	VSOut output = VSMain(input);
 
+#if MULTI_VIEW
+	// VSMain outputs the world-space position shared by all the views. The views of a
+	// primitive are interleaved, so that the view of primitive p is p % g_numViews.
+	const uint baseVIdx = (DTid / 3) * g_numViews * 3 + DTid % 3;
+	for (uint i = 0; i < g_numViews; ++i)
+		g_rwVertexPos[baseVIdx + i * 3] = mul(output.Pos, g_viewProjs[i]);
+#else
 	g_rwVertexPos[DTid] = output.Pos;
+#endif
 
+	// The attribute outputs are dead code in depth-only passes
+#if !DEPTH_ONLY
 #include "SetAttributes.hlsli"
+#endif
 }
@@ -0,0 +1,7 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define DEPTH_ONLY 1
+#define MULTI_VIEW 1
+#include "VSStageIndexed.hlsl"
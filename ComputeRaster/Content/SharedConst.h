@@ -2,6 +2,9 @@
 // Copyright (c) XU, Tianchen. All rights reserved.
 //--------------------------------------------------------------------------------------
 
+#ifndef SHARED_CONST_H
+#define SHARED_CONST_H
+
 #define	FRAME_COUNT	3
 
 #define	USE_TRIPPLE_RASTER	1
@@ -12,6 +15,13 @@
 #define BIN_SIZE_LOG	(TILE_SIZE_LOG + TILE_TO_BIN_LOG)
 #define BIN_SIZE		(1 << BIN_SIZE_LOG)
 
+#define MAX_VIEWS		8
+#define CLUSTER_SIZE	64	// Primitives of a thread group of the bin raster
+#define CACHE_DRAW_ID_SHIFT	24	// The temporal cache stores the draw of a frame above the primitive
+
+#define EARLY_Z_STATS	0	// Count the work rejected by the depth early-outs
+#define PIPELINE_STATS	1	// Count the work of the raster stages
+
 #define CLEAR_COLOR	0.0f, 0.2f, 0.4f
 
 #define	PIDIV4		0.785398163f
@@ -19,3 +29,5 @@
 static const float g_FOVAngleY = PIDIV4;
 static const float g_zNear = 1.0f;
 static const float g_zFar = 1000.0f;
+
+#endif
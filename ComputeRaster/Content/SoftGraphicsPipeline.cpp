@@ -4,22 +4,85 @@
 
 #include "Optional/XUSGObjLoader.h"
 #include "SoftGraphicsPipeline.h"
+#include "Tracer.h"
 
 using namespace std;
 using namespace DirectX;
 using namespace XUSG;
 
+// Candidate areas, in tiles, above which a primitive goes through the bin raster
+static const float g_binThresholds[] = { 4.0f, 8.0f, 16.0f, 32.0f, 64.0f, 128.0f, 256.0f };
+
+// Hi-Z levels generated by each pass of GenHiZ.hlsl
+static const uint32_t g_hiZLevelsPerPass = 4;
+
+// Difference of the reprojected depth from that of the history, within which the temporal
+// cache hits, for the half-pixel offset of the nearest pixel of the history
+static const float g_cacheDepthTolerance = 1.0e-3f;
+
+// Capacity of the constant ring, for the constants of the draws of all frames in flight
+static const uint32_t g_constantRingSize = 64 * ConstantRing::MaxSliceSize;
+
+// Capacities of the primitive lists, in primitives. The buffers are at the size limit
+// already, so the views of a multi-view draw share them rather than scaling them.
+static const uint32_t g_tileBufferSize = (UINT32_MAX >> 4) + 1;
+static const uint32_t g_binBufferSize = g_tileBufferSize >> 6;
+
 SoftGraphicsPipeline::SoftGraphicsPipeline(const Device& device) :
 	m_device(device),
+	m_pClears(nullptr),
+	m_numClears(0),
+	m_numDraws(0),
+	m_numColorDraws(0),
+	m_outTableKeys(),
+	m_depthOutTableKeys(),
+	m_srvTableKeys(),
+	m_uavTableKeys(),
+	m_rsTableKeys(),
+	m_numRsDescriptors(0),
+	m_pVertexBuffer(nullptr),
+	m_pIndexBuffer(nullptr),
 	m_pColorTarget(nullptr),
 	m_pDepth(nullptr),
+	m_pShadingRate(nullptr),
+	m_isScissorEnabled(false),
+	m_binThresholdTuner(g_binThresholds, static_cast<uint32_t>(size(g_binThresholds)), 16.0f),
+	m_passMode(PassMode::DEFAULT),
+	m_numViews(0),
+	m_maxNumViews(1),
+	m_cbViewsOffset(0),
+	m_cbCullOffset(0),
+	m_cbCacheOffset(0),
+	m_frameIndex(0),
+	m_reprojection(),
+	m_occlusionCulling(false),
+	m_pClusterOrder(nullptr),
+	m_earlyZStats(),
+	m_pipelineStats(),
+	m_trianglesIn(),
+	m_pTemporalCache(nullptr),
+	m_temporalCacheStats(),
+	m_transientMemory(0),
+	m_cacheRefreshPeriod(1),
+	m_cacheFrameIdx(0),
+	m_isCacheHistoryValid(false),
 	m_maxVertexCount(0),
-	m_clearDepth(0xffffffff)
+	m_maxClusterCount(0),
+	m_numColorTargets(0),
+	m_clearDepth(0xffffffff),
+	m_reshadeViewport(),
+	m_pReshadeDepth(nullptr)
 {
 	m_shaderPool = ShaderPool::MakeUnique();
 	m_computePipelineCache = Compute::PipelineCache::MakeUnique(device);
 	m_descriptorTableCache = DescriptorTableCache::MakeUnique(device);
 	m_pipelineLayoutCache = PipelineLayoutCache::MakeUnique(device);
+
+	// Util descriptor tables are reused for every rebuild of the transient tables
+	for (auto& utilTable : m_utilTables) utilTable = Util::DescriptorTable::MakeUnique();
+
+	// The tables of the single output views never grow
+	m_outTables.reserve(MaxRenderTargets + 3);
 }
 
 SoftGraphicsPipeline::~SoftGraphicsPipeline()
@@ -28,9 +91,6 @@ SoftGraphicsPipeline::~SoftGraphicsPipeline()
 
 bool SoftGraphicsPipeline::Init(CommandList* pCommandList, vector<Resource>& uploaders)
 {
-	const uint32_t tileBufferSize = (UINT32_MAX >> 4) + 1;
-	const uint32_t binBufferSize = tileBufferSize >> 6;
-
 	// Create buffers
 	m_tilePrimCount = StructuredBuffer::MakeUnique();
 	N_RETURN(m_tilePrimCount->Create(m_device, 3, sizeof(uint32_t),
@@ -38,7 +98,7 @@ bool SoftGraphicsPipeline::Init(CommandList* pCommandList, vector<Resource>& upl
 		1, nullptr, 1, nullptr, L"TilePrimitiveCount"), false);
 
 	m_tilePrimitives = StructuredBuffer::MakeUnique();
-	N_RETURN(m_tilePrimitives->Create(m_device, tileBufferSize, sizeof(uint32_t[2]),
+	N_RETURN(m_tilePrimitives->Create(m_device, g_tileBufferSize, sizeof(uint32_t[2]),
 		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1,
 		nullptr, 1, nullptr, L"TilePrimitives"), false);
 
@@ -48,10 +108,40 @@ bool SoftGraphicsPipeline::Init(CommandList* pCommandList, vector<Resource>& upl
 		1, nullptr, 1, nullptr, L"BinPrimitiveCount"), false);
 
 	m_binPrimitives = StructuredBuffer::MakeUnique();
-	N_RETURN(m_binPrimitives->Create(m_device, binBufferSize, sizeof(uint32_t[2]),
+	N_RETURN(m_binPrimitives->Create(m_device, g_binBufferSize, sizeof(uint32_t[2]),
 		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1,
 		nullptr, 1, nullptr, L"BinPrimitives"), false);
 
+	m_rejectedCount = StructuredBuffer::MakeUnique();
+	N_RETURN(m_rejectedCount->Create(m_device, 3, sizeof(uint32_t),
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT,
+		1, nullptr, 1, nullptr, L"RejectedClusterCount"), false);
+
+	m_statCounters = StructuredBuffer::MakeUnique();
+	N_RETURN(m_statCounters->Create(m_device, SizeOfInUint32(StatCounters), sizeof(uint32_t),
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT,
+		1, nullptr, 1, nullptr, L"StatCounters"), false);
+
+#if EARLY_Z_STATS || PIPELINE_STATS
+	// The counters of each frame slot are read back when the slot is reused
+	m_statReadback = StructuredBuffer::MakeUnique();
+	N_RETURN(m_statReadback->Create(m_device, SizeOfInUint32(StatCounters) * FrameCount,
+		sizeof(uint32_t), ResourceFlag::NONE, MemoryType::READBACK,
+		0, nullptr, 0, nullptr, L"StatReadback"), false);
+#endif
+
+	m_cacheCounters = StructuredBuffer::MakeUnique();
+	N_RETURN(m_cacheCounters->Create(m_device, SizeOfInUint32(TemporalCacheStats), sizeof(uint32_t),
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT,
+		1, nullptr, 1, nullptr, L"TemporalCacheCounters"), false);
+
+	m_cacheReadback = StructuredBuffer::MakeUnique();
+	N_RETURN(m_cacheReadback->Create(m_device, SizeOfInUint32(TemporalCacheStats) * FrameCount,
+		sizeof(uint32_t), ResourceFlag::NONE, MemoryType::READBACK,
+		0, nullptr, 0, nullptr, L"TemporalCacheReadback"), false);
+
+	N_RETURN(m_constantRing.Create(m_device, g_constantRingSize), false);
+
 	// create reset buffer for resetting TilePrimitiveCount
 	N_RETURN(createResetBuffer(pCommandList, uploaders), false);
 
@@ -61,10 +151,42 @@ bool SoftGraphicsPipeline::Init(CommandList* pCommandList, vector<Resource>& upl
 	return true;
 }
 
+void SoftGraphicsPipeline::BeginFrame(uint32_t frameIndex)
+{
+	// The transient objects of this frame slot are no longer referenced
+	m_frameArena.Reset(frameIndex);
+	m_constantRing.BeginFrame(frameIndex);
+	m_frameIndex = frameIndex;
+	m_pClears = nullptr;
+	m_numClears = 0;
+	m_numDraws = 0;
+	m_numColorDraws = 0;
+
+#if EARLY_Z_STATS || PIPELINE_STATS
+	// The previous frame of this slot has completed on the GPU
+	const auto pStats = reinterpret_cast<const StatCounters*>(m_statReadback->Map(0,
+		sizeof(StatCounters) * frameIndex, sizeof(StatCounters) * (frameIndex + 1)));
+	m_earlyZStats = pStats[frameIndex].EarlyZ;
+	m_pipelineStats = pStats[frameIndex].Pipeline;
+	m_statReadback->Unmap();
+	m_pipelineStats.TrianglesIn = m_trianglesIn[frameIndex];
+#endif
+	m_trianglesIn[frameIndex] = 0;
+
+	if (m_pTemporalCache)
+	{
+		const auto pStats = reinterpret_cast<const TemporalCacheStats*>(m_cacheReadback->Map(0,
+			sizeof(TemporalCacheStats) * frameIndex, sizeof(TemporalCacheStats) * (frameIndex + 1)));
+		m_temporalCacheStats = pStats[frameIndex];
+		m_cacheReadback->Unmap();
+	}
+}
+
 bool SoftGraphicsPipeline::CreateVertexShaderLayout(Util::PipelineLayout* pPipelineLayout,
 	uint32_t slotCount, int32_t srvBindingMax, int32_t uavBindingMax)
 {
 	m_extVsTables.resize(slotCount);
+	m_extVsCbOffsets.assign(slotCount, UINT32_MAX);
 	const auto numUAVs = static_cast<uint32_t>(m_vertexAttribs.size()) + 1;
 	//auto pPipelineLayoutIndexed = pPipelineLayout;
 
@@ -80,6 +202,17 @@ bool SoftGraphicsPipeline::CreateVertexShaderLayout(Util::PipelineLayout* pPipel
 	}
 
 	m_pipelineLayouts[VERTEX_INDEXED] = m_pipelineLayouts[VERTEX_PROCESS];
+	m_pipelineLayouts[VERTEX_DEPTH] = m_pipelineLayouts[VERTEX_PROCESS];
+	m_pipelineLayouts[VERTEX_INDEXED_DEPTH] = m_pipelineLayouts[VERTEX_PROCESS];
+
+	// The multi-view variants read the views from a root CBV in space 1
+	{
+		pPipelineLayout->SetRootCBV(slotCount + 2, 0, 1);
+		X_RETURN(m_pipelineLayouts[VERTEX_MULTI_VIEW], pPipelineLayout->GetPipelineLayout(
+			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"VertexShaderStageMultiViewLayout"), false);
+	}
+
+	m_pipelineLayouts[VERTEX_INDEXED_MULTI_VIEW] = m_pipelineLayouts[VERTEX_MULTI_VIEW];
 
 	return true;
 }
@@ -89,6 +222,7 @@ bool SoftGraphicsPipeline::CreatePixelShaderLayout(Util::PipelineLayout* pPipeli
 	int32_t srvBindingMax, int32_t uavBindingMax)
 {
 	m_extPsTables.resize(slotCount);
+	m_extPsCbOffsets.assign(slotCount, UINT32_MAX);
 
 	// Create pipeline layouts
 	{
@@ -101,10 +235,26 @@ bool SoftGraphicsPipeline::CreatePixelShaderLayout(Util::PipelineLayout* pPipeli
 			DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
 		pPipelineLayout->SetRange(slotCount + 3, DescriptorType::UAV, hasDepth ? numRTs + 2 : numRTs,
 			uavBindingMax + 2, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pPipelineLayout->SetRootUAV(slotCount + 4, 0, 2);
+		pPipelineLayout->SetRange(slotCount + 5, DescriptorType::SRV, 1, 0, 1,
+			DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		// The history, the primitive IDs, the counters and the constants of the temporal cache
+		pPipelineLayout->SetRange(slotCount + 6, DescriptorType::SRV, 3, 0, 3,
+			DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pPipelineLayout->SetRange(slotCount + 7, DescriptorType::UAV, 2, 0, 3,
+			DescriptorFlag::DESCRIPTORS_VOLATILE | DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pPipelineLayout->SetRootCBV(slotCount + 8, 0, 3);
 		X_RETURN(m_pipelineLayouts[PIX_RASTER], pPipelineLayout->GetPipelineLayout(
 			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"PixelRasterLayout"), false);
 	}
 
+	m_pipelineLayouts[PIX_RASTER_DEPTH] = m_pipelineLayouts[PIX_RASTER];
+	m_pipelineLayouts[PIX_RASTER_EQUAL] = m_pipelineLayouts[PIX_RASTER];
+	m_pipelineLayouts[PIX_RASTER_COARSE] = m_pipelineLayouts[PIX_RASTER];
+	m_pipelineLayouts[PIX_RASTER_EQUAL_COARSE] = m_pipelineLayouts[PIX_RASTER];
+	m_pipelineLayouts[PIX_RASTER_CACHE] = m_pipelineLayouts[PIX_RASTER];
+	m_pipelineLayouts[PIX_RASTER_EQUAL_CACHE] = m_pipelineLayouts[PIX_RASTER];
+
 	return true;
 }
 
@@ -118,49 +268,75 @@ void SoftGraphicsPipeline::SetAttribute(uint32_t i, uint32_t stride, Format form
 	m_attribInfo[i].Name = name;
 }
 
-void SoftGraphicsPipeline::SetVertexBuffer(const Descriptor& vertexBufferView)
+void SoftGraphicsPipeline::SetVertexBuffer(const VertexBuffer& vertexBuffer)
 {
-	m_vertexBufferView = vertexBufferView;
+	m_pVertexBuffer = &vertexBuffer;
 }
 
-void SoftGraphicsPipeline::SetIndexBuffer(const Descriptor& indexBufferView)
+void SoftGraphicsPipeline::SetIndexBuffer(const IndexBuffer& indexBuffer)
 {
-	m_indexBufferView = indexBufferView;
+	m_pIndexBuffer = &indexBuffer;
 }
 
 void SoftGraphicsPipeline::SetRenderTargets(uint32_t numRTs, Texture2D* pColorTarget, DepthBuffer* pDepth)
 {
+	assert(numRTs <= MaxRenderTargets);
+	const auto numViews = pDepth ? numRTs + 3 : numRTs;
+
+	// The util tables only grow, so another number of views needs new ones
+	if (numRTs != m_numColorTargets || numViews != m_outTables.size())
+	{
+		m_utilTables[UTIL_TABLE_OUT] = Util::DescriptorTable::MakeUnique();
+		m_utilTables[UTIL_TABLE_OUT_DEPTH] = Util::DescriptorTable::MakeUnique();
+		m_outTable = nullptr;
+		m_depthOutTable = nullptr;
+	}
+
 	m_pColorTarget = pColorTarget;
 	m_pDepth = pDepth;
 	m_numColorTargets = numRTs;
 
-	m_outTables.resize(pDepth ? numRTs + 3 : numRTs);
+	// The pixel raster binds the targets, PixelZ and TileZ as a single range, so they are
+	// one table, which BinZ ends for the clears
+	Descriptor descriptors[MaxRenderTargets + 3];
+	const ResourceBase* pResources[MaxRenderTargets + 3];
 	for (auto i = 0u; i < numRTs; ++i)
 	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0, 1, &pColorTarget->GetUAV());
-		m_outTables[i] = descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache);
+		descriptors[i] = pColorTarget[i].GetUAV();
+		pResources[i] = &pColorTarget[i];
 	}
 
 	if (pDepth)
 	{
+		const Texture2D* const pDepths[] = { pDepth->PixelZ.get(), pDepth->TileZ.get(), pDepth->BinZ.get() };
+		for (auto i = 0u; i < 3; ++i)
 		{
-			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-			descriptorTable->SetDescriptors(0, 1, &pDepth->PixelZ->GetUAV());
-			m_outTables[m_outTables.size() - 1] = descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache);
+			descriptors[numRTs + i] = pDepths[i]->GetUAV();
+			pResources[numRTs + i] = pDepths[i];
 		}
+	}
 
-		{
-			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-			descriptorTable->SetDescriptors(0, 1, &pDepth->TileZ->GetUAV());
-			m_outTables[m_outTables.size() - 2] = descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache);
-		}
+	if (updateDescriptorTable(m_outTable, m_outTableKeys, UTIL_TABLE_OUT, numViews, descriptors, pResources))
+	{
+		const auto stride = m_descriptorTableCache->GetDescriptorStride(CBV_SRV_UAV_POOL);
+		m_outTables.resize(numViews);
+		for (auto i = 0u; i < numViews; ++i)
+			m_outTables[i] = make_shared<CD3DX12_GPU_DESCRIPTOR_HANDLE>(*m_outTable, i, stride);
+	}
 
+	// The depth-only variant declares no targets, so its range starts at PixelZ
+	if (pDepth)
+	{
+		Descriptor depthDescriptors[MaxRenderTargets + 2];
+		const ResourceBase* pDepthResources[MaxRenderTargets + 2];
+		for (auto i = 0u; i < numRTs + 2; ++i)
 		{
-			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-			descriptorTable->SetDescriptors(0, 1, &pDepth->BinZ->GetUAV());
-			m_outTables[m_outTables.size() - 3] = descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache);
+			const auto j = (numRTs + i) % (numRTs + 2);
+			depthDescriptors[i] = descriptors[j];
+			pDepthResources[i] = pResources[j];
 		}
+		updateDescriptorTable(m_depthOutTable, m_depthOutTableKeys, UTIL_TABLE_OUT_DEPTH,
+			numRTs + 2, depthDescriptors, pDepthResources);
 	}
 }
 
@@ -169,30 +345,162 @@ void SoftGraphicsPipeline::SetViewport(const Viewport& viewport)
 	m_viewport = viewport;
 }
 
+void SoftGraphicsPipeline::SetScissorRect(const RectRange* pRect)
+{
+	m_isScissorEnabled = pRect != nullptr;
+	if (pRect) m_scissorRect = *pRect;
+}
+
+void SoftGraphicsPipeline::SetPassMode(PassMode mode)
+{
+	m_passMode = mode;
+}
+
+void SoftGraphicsPipeline::SetViews(uint32_t numViews, const XMFLOAT4X4* pViewProjs, const Viewport* pViewports)
+{
+	assert(numViews > 0 && numViews <= MaxViews);
+	// The vertex positions of all the views are allocated by the first draw
+	assert(!m_vertexPos || numViews <= m_maxNumViews);
+	m_numViews = numViews;
+	m_maxNumViews = (max)(m_maxNumViews, numViews);
+
+	for (auto i = 0u; i < numViews; ++i)
+	{
+		// Bin-aligned rectangles keep the bins and tiles of the views apart
+		assert(static_cast<uint32_t>(pViewports[i].TopLeftX) % BIN_SIZE == 0);
+		assert(static_cast<uint32_t>(pViewports[i].TopLeftY) % BIN_SIZE == 0);
+		m_viewProjs[i] = pViewProjs[i];
+		m_viewViewports[i] = pViewports[i];
+	}
+}
+
+void SoftGraphicsPipeline::SetOcclusionCulling(bool enable)
+{
+	m_occlusionCulling = enable;
+}
+
+void SoftGraphicsPipeline::SetReprojection(const XMFLOAT4X4& reprojection)
+{
+	m_reprojection = reprojection;
+}
+
+void SoftGraphicsPipeline::SetClusterOrder(const uint32_t* pClusterOrder)
+{
+	m_pClusterOrder = pClusterOrder;
+}
+
+void SoftGraphicsPipeline::SetShadingRateImage(Texture2D* pRateImage)
+{
+	m_pShadingRate = pRateImage;
+	if (!pRateImage) return;
+
+	const Descriptor descriptors[] =
+	{
+		pRateImage->GetSRV()
+	};
+	const ResourceBase* const pResources[] = { pRateImage };
+	updateDescriptorTable(m_srvTables[SRV_TABLE_RATE], m_srvTableKeys[SRV_TABLE_RATE],
+		UTIL_TABLE_RATE, static_cast<uint32_t>(size(descriptors)), descriptors, pResources);
+}
+
+void SoftGraphicsPipeline::SetTemporalCache(TemporalCache* pCache, uint32_t refreshPeriod)
+{
+	assert(refreshPeriod > 0);
+	// The history of another cache, or from before the cache was disabled, is not that
+	// of the previous frame
+	m_isCacheHistoryValid = m_isCacheHistoryValid && pCache == m_pTemporalCache;
+	m_pTemporalCache = pCache;
+	m_cacheRefreshPeriod = refreshPeriod;
+	if (!pCache) return;
+
+	const Descriptor srvs[] =
+	{
+		pCache->Color->GetSRV(),
+		pCache->Depth->GetSRV(),
+		pCache->PrevPrimitiveId->GetSRV()
+	};
+	const ResourceBase* const pSrvResources[] =
+	{
+		pCache->Color.get(),
+		pCache->Depth.get(),
+		pCache->PrevPrimitiveId.get()
+	};
+	updateDescriptorTable(m_srvTables[SRV_TABLE_CACHE], m_srvTableKeys[SRV_TABLE_CACHE],
+		UTIL_TABLE_CACHE_SRV, static_cast<uint32_t>(size(srvs)), srvs, pSrvResources);
+
+	const Descriptor uavs[] =
+	{
+		pCache->PrimitiveId->GetUAV(),
+		m_cacheCounters->GetUAV()
+	};
+	const ResourceBase* const pUavResources[] =
+	{
+		pCache->PrimitiveId.get(),
+		m_cacheCounters.get()
+	};
+	updateDescriptorTable(m_uavTables[UAV_TABLE_CACHE], m_uavTableKeys[UAV_TABLE_CACHE],
+		UTIL_TABLE_CACHE_UAV, static_cast<uint32_t>(size(uavs)), uavs, pUavResources);
+}
+
+void SoftGraphicsPipeline::SetBinThreshold(float numTiles)
+{
+	m_binThresholdTuner.SetFixed(numTiles);
+}
+
+void SoftGraphicsPipeline::AutoTuneBinThreshold()
+{
+	m_binThresholdTuner.Start();
+}
+
+void SoftGraphicsPipeline::ReportFrameCost(double frameTime)
+{
+	// XUSG exposes no timestamp queries, so each threshold is rated by the frame time
+	m_binThresholdTuner.Update(frameTime);
+}
+
 void SoftGraphicsPipeline::VSSetDescriptorTable(uint32_t i, const DescriptorTable& descriptorTable)
 {
 	m_extVsTables[i] = descriptorTable;
+	m_extVsCbOffsets[i] = UINT32_MAX;
 }
 
 void SoftGraphicsPipeline::PSSetDescriptorTable(uint32_t i, const DescriptorTable& descriptorTable)
 {
 	m_extPsTables[i] = descriptorTable;
+	m_extPsCbOffsets[i] = UINT32_MAX;
+}
+
+ConstantRing::Slice SoftGraphicsPipeline::AllocateConstants(uint32_t size)
+{
+	return m_constantRing.Allocate(size);
+}
+
+void SoftGraphicsPipeline::VSSetConstantBuffer(uint32_t i, const ConstantRing::Slice& slice)
+{
+	assert(slice.pData);
+	m_extVsCbOffsets[i] = slice.Offset;
+}
+
+void SoftGraphicsPipeline::PSSetConstantBuffer(uint32_t i, const ConstantRing::Slice& slice)
+{
+	assert(slice.pData);
+	m_extPsCbOffsets[i] = slice.Offset;
 }
 
 void SoftGraphicsPipeline::ClearFloat(const Texture2D& target, const float clearValues[4])
 {
-	m_clears.emplace_back();
-	m_clears.back().IsUint = false;
-	m_clears.back().pTarget = &target;
-	memcpy(m_clears.back().ClearFloat, clearValues, sizeof(float[4]));
+	auto& clear = appendClear();
+	clear.IsUint = false;
+	clear.pTarget = &target;
+	memcpy(clear.ClearFloat, clearValues, sizeof(float[4]));
 }
 
 void SoftGraphicsPipeline::ClearUint(const Texture2D& target, const uint32_t clearValues[4])
 {
-	m_clears.emplace_back();
-	m_clears.back().IsUint = true;
-	m_clears.back().pTarget = &target;
-	memcpy(m_clears.back().ClearUint, clearValues, sizeof(uint32_t[4]));
+	auto& clear = appendClear();
+	clear.IsUint = true;
+	clear.pTarget = &target;
+	memcpy(clear.ClearUint, clearValues, sizeof(uint32_t[4]));
 }
 
 void SoftGraphicsPipeline::ClearDepth(const float clearValue)
@@ -202,31 +510,223 @@ void SoftGraphicsPipeline::ClearDepth(const float clearValue)
 
 void SoftGraphicsPipeline::Draw(CommandList* pCommandList, uint32_t numVertices)
 {
-	const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+	assert(m_pVertexBuffer);
 	const Descriptor descriptors[] =
 	{
-		m_vertexBufferView
+		m_pVertexBuffer->GetSRV()
 	};
-	descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-	m_srvTables[SRV_TABLE_VS] = descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache);
+	const ResourceBase* const pResources[] = { m_pVertexBuffer };
+	updateDescriptorTable(m_srvTables[SRV_TABLE_VS], m_srvTableKeys[SRV_TABLE_VS],
+		UTIL_TABLE_VS, static_cast<uint32_t>(size(descriptors)), descriptors, pResources);
 
 	draw(pCommandList, numVertices, VERTEX_PROCESS);
 }
 
 void SoftGraphicsPipeline::DrawIndexed(CommandList* pCommandList, uint32_t numIndices)
 {
-	const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+	assert(m_pVertexBuffer && m_pIndexBuffer);
 	const Descriptor descriptors[] =
 	{
-		m_vertexBufferView,
-		m_indexBufferView
+		m_pVertexBuffer->GetSRV(),
+		m_pIndexBuffer->GetSRV()
 	};
-	descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-	m_srvTables[SRV_TABLE_VS] = descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache);
+	const ResourceBase* const pResources[] = { m_pVertexBuffer, m_pIndexBuffer };
+	updateDescriptorTable(m_srvTables[SRV_TABLE_VS_INDEXED], m_srvTableKeys[SRV_TABLE_VS_INDEXED],
+		UTIL_TABLE_VS_INDEXED, static_cast<uint32_t>(size(descriptors)), descriptors, pResources);
 
 	draw(pCommandList, numIndices, VERTEX_INDEXED);
 }
 
+bool SoftGraphicsPipeline::Reshade(CommandList* pCommandList)
+{
+	if (!m_pReshadeDepth || m_pReshadeDepth != m_pDepth) return false;
+	TRACE_SCOPE(DRAW, L"Reshade");
+
+	setDescriptorPools(pCommandList);
+
+	// Set resource barriers and clear
+	const auto coarse = m_pShadingRate != nullptr;
+	const auto barriers = m_frameArena.Allocate<ResourceBarrier>(
+		m_numClears + static_cast<uint32_t>(m_vertexAttribs.size()) + 9);
+	auto numBarriers = 0u;
+	for (auto i = 0u; i < m_numClears; ++i)
+		numBarriers = m_pColorTarget[i].SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	if (m_pTemporalCache && m_numClears > 0)
+		numBarriers = m_pTemporalCache->PrimitiveId->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_tilePrimCount->SetBarrier(barriers, ResourceState::INDIRECT_ARGUMENT, numBarriers);
+	numBarriers = m_tilePrimitives->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+	for (auto& attrib : m_vertexAttribs)
+		numBarriers = attrib->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+	numBarriers = m_pDepth->PixelZ->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_pDepth->TileZ->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	if (coarse) numBarriers = m_pShadingRate->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+#if EARLY_Z_STATS || PIPELINE_STATS
+	const auto resetStats = m_numDraws == 0;
+	if (resetStats) numBarriers = m_statCounters->SetBarrier(barriers, ResourceState::COPY_DEST, numBarriers);
+#endif
+	// The reshading replaces the stale colors that the temporal cache would reuse, so
+	// nothing is reused in this frame
+	const auto resetCache = m_pTemporalCache && m_numDraws == 0;
+	if (resetCache) numBarriers = m_cacheCounters->SetBarrier(barriers, ResourceState::COPY_DEST, numBarriers);
+	if (m_numDraws++ > 0) pCommandList->Barrier(numBarriers, barriers);
+
+	clearTargets(pCommandList);
+
+	if (resetCache)
+		for (auto i = 0u; i < SizeOfInUint32(TemporalCacheStats); ++i)
+			pCommandList->CopyBufferRegion(m_cacheCounters->GetResource(), sizeof(uint32_t) * i,
+				m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
+
+#if EARLY_Z_STATS || PIPELINE_STATS
+	if (resetStats)
+	{
+		for (auto i = 0u; i < SizeOfInUint32(StatCounters); ++i)
+			pCommandList->CopyBufferRegion(m_statCounters->GetResource(), sizeof(uint32_t) * i,
+				m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
+		numBarriers = m_statCounters->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+		pCommandList->Barrier(numBarriers, barriers);
+	}
+#endif
+
+	// Pixel raster
+	pixelRaster(pCommandList, m_reshadeViewport, coarse ? PIX_RASTER_EQUAL_COARSE : PIX_RASTER_EQUAL);
+
+#if EARLY_Z_STATS || PIPELINE_STATS
+	numBarriers = m_statCounters->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+	pCommandList->CopyBufferRegion(m_statReadback->GetResource(), sizeof(StatCounters) * m_frameIndex,
+		m_statCounters->GetResource(), 0, sizeof(StatCounters));
+#endif
+
+	return true;
+}
+
+void SoftGraphicsPipeline::GenerateHiZ(CommandList* pCommandList)
+{
+	assert(m_pDepth);
+	const auto& hiZ = m_pDepth->HiZ;
+	updateHiZTables();
+
+	// Set resource barriers
+	const auto barriers = m_frameArena.Allocate<ResourceBarrier>(2);
+	auto numBarriers = m_pDepth->PixelZ->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+	numBarriers = hiZ->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[GEN_HI_Z]);
+	pCommandList->SetPipelineState(m_pipelines[GEN_HI_Z]);
+
+	const auto numLevels = getNumHiZLevels();
+	const auto numPasses = static_cast<uint32_t>(m_hiZTables.size());
+	for (auto i = 0u; i < numPasses; ++i)
+	{
+		// Each pass reads the last level written by the previous pass
+		if (i > 0)
+		{
+			numBarriers = hiZ->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+			pCommandList->Barrier(numBarriers, barriers);
+		}
+
+		const auto level = g_hiZLevelsPerPass * i;
+		pCommandList->SetCompute32BitConstant(0, (min)(numLevels - level, g_hiZLevelsPerPass));
+		pCommandList->SetComputeDescriptorTable(1, m_hiZTables[i]);
+		pCommandList->Dispatch(DIV_UP((max)(hiZ->GetWidth() >> level, 1u), 8),
+			DIV_UP((max)(hiZ->GetHeight() >> level, 1u), 8), 1);
+	}
+
+	numBarriers = hiZ->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+}
+
+void SoftGraphicsPipeline::GenerateShadingRate(CommandList* pCommandList, Texture2D& rateImage, float threshold)
+{
+	assert(m_pDepth && m_pipelines[GEN_SHADING_RATE]);
+	const Descriptor descriptors[] =
+	{
+		m_pDepth->PixelZ->GetUAV(),
+		rateImage.GetUAV()
+	};
+	const ResourceBase* const pResources[] = { m_pDepth->PixelZ.get(), &rateImage };
+	updateDescriptorTable(m_uavTables[UAV_TABLE_RATE], m_uavTableKeys[UAV_TABLE_RATE],
+		UTIL_TABLE_RATE_GEN, static_cast<uint32_t>(size(descriptors)), descriptors, pResources);
+
+	// Set resource barriers
+	const auto barriers = m_frameArena.Allocate<ResourceBarrier>(2);
+	auto numBarriers = m_pDepth->PixelZ->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+	numBarriers = rateImage.SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[GEN_SHADING_RATE]);
+	pCommandList->SetPipelineState(m_pipelines[GEN_SHADING_RATE]);
+	pCommandList->SetCompute32BitConstant(0, reinterpret_cast<const uint32_t&>(threshold));
+	pCommandList->SetComputeDescriptorTable(1, m_uavTables[UAV_TABLE_RATE]);
+
+	// Dispatch a thread group per tile
+	pCommandList->Dispatch(rateImage.GetWidth(), rateImage.GetHeight(), 1);
+
+	numBarriers = rateImage.SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+}
+
+void SoftGraphicsPipeline::Upscale(CommandList* pCommandList, Texture2D& source, Texture2D& output,
+	uint32_t width, uint32_t height)
+{
+	assert(m_pipelines[UPSCALE]);
+	const auto srv = source.GetSRV();
+	const auto uav = output.GetUAV();
+	const ResourceBase* const pSource = &source;
+	const ResourceBase* const pOutput = &output;
+	updateDescriptorTable(m_srvTables[SRV_TABLE_UPSCALE], m_srvTableKeys[SRV_TABLE_UPSCALE],
+		UTIL_TABLE_UPSCALE_SRC, 1, &srv, &pSource);
+	updateDescriptorTable(m_uavTables[UAV_TABLE_UPSCALE], m_uavTableKeys[UAV_TABLE_UPSCALE],
+		UTIL_TABLE_UPSCALE_DST, 1, &uav, &pOutput);
+
+	// Set resource barriers
+	const auto barriers = m_frameArena.Allocate<ResourceBarrier>(2);
+	auto numBarriers = source.SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	numBarriers = output.SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	const float srcSize[] = { static_cast<float>(width), static_cast<float>(height) };
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[UPSCALE]);
+	pCommandList->SetPipelineState(m_pipelines[UPSCALE]);
+	pCommandList->SetCompute32BitConstants(0, SizeOfInUint32(srcSize), srcSize);
+	pCommandList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_UPSCALE]);
+	pCommandList->SetComputeDescriptorTable(2, m_uavTables[UAV_TABLE_UPSCALE]);
+
+	pCommandList->Dispatch(DIV_UP(output.GetWidth(), 8), DIV_UP(output.GetHeight(), 8), 1);
+}
+
+void SoftGraphicsPipeline::UpdateTemporalCache(CommandList* pCommandList)
+{
+	assert(m_pTemporalCache && m_pColorTarget && m_pDepth);
+	auto& cache = *m_pTemporalCache;
+
+	// Set resource barriers
+	const auto barriers = m_frameArena.Allocate<ResourceBarrier>(7);
+	auto numBarriers = m_pColorTarget->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+	numBarriers = m_pDepth->PixelZ->SetBarrier(barriers, ResourceState::COPY_SOURCE, numBarriers);
+	numBarriers = cache.PrimitiveId->SetBarrier(barriers, ResourceState::COPY_SOURCE, numBarriers);
+	numBarriers = cache.Color->SetBarrier(barriers, ResourceState::COPY_DEST, numBarriers);
+	numBarriers = cache.Depth->SetBarrier(barriers, ResourceState::COPY_DEST, numBarriers);
+	numBarriers = cache.PrevPrimitiveId->SetBarrier(barriers, ResourceState::COPY_DEST, numBarriers);
+	numBarriers = m_cacheCounters->SetBarrier(barriers, ResourceState::COPY_SOURCE, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	pCommandList->CopyResource(cache.Color->GetResource(), m_pColorTarget->GetResource());
+	pCommandList->CopyResource(cache.Depth->GetResource(), m_pDepth->PixelZ->GetResource());
+	pCommandList->CopyResource(cache.PrevPrimitiveId->GetResource(), cache.PrimitiveId->GetResource());
+	pCommandList->CopyBufferRegion(m_cacheReadback->GetResource(), sizeof(TemporalCacheStats) * m_frameIndex,
+		m_cacheCounters->GetResource(), 0, sizeof(TemporalCacheStats));
+
+	// The refreshes rotate over the pixels from frame to frame
+	++m_cacheFrameIdx;
+	m_isCacheHistoryValid = true;
+}
+
 bool SoftGraphicsPipeline::CreateDepthBuffer(DepthBuffer& depth, uint32_t width, uint32_t height,
 	Format format, const wchar_t* name)
 {
@@ -245,6 +745,53 @@ bool SoftGraphicsPipeline::CreateDepthBuffer(DepthBuffer& depth, uint32_t width,
 		format, 1, ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS,
 		1, 1, MemoryType::DEFAULT, false, (wstring(name) + L".BinZ").c_str()), false);
 
+	// The levels of the Hi-Z are powers of two down to 1x1, so that each texel covers
+	// exactly 2x2 texels of the finer level, and level 0 covers 2x2 pixels.
+	auto hiZWidth = 1u, hiZHeight = 1u;
+	while ((hiZWidth << 1) < width) hiZWidth <<= 1;
+	while ((hiZHeight << 1) < height) hiZHeight <<= 1;
+	const auto numHiZLevels = static_cast<uint8_t>(log2((max)(hiZWidth, hiZHeight))) + 1;
+	depth.HiZ = Texture2D::MakeUnique();
+	N_RETURN(depth.HiZ->Create(m_device, hiZWidth, hiZHeight, format, 1,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS,
+		numHiZLevels, 1, MemoryType::DEFAULT, false, (wstring(name) + L".HiZ").c_str()), false);
+
+	return true;
+}
+
+bool SoftGraphicsPipeline::CreateShadingRateImage(Texture2D& rateImage,
+	uint32_t width, uint32_t height, const wchar_t* name)
+{
+	// A texel per tile
+	return rateImage.Create(m_device, DIV_UP(width, TILE_SIZE), DIV_UP(height, TILE_SIZE),
+		Format::R8_UINT, 1, ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1,
+		MemoryType::DEFAULT, false, name);
+}
+
+bool SoftGraphicsPipeline::CreateTemporalCache(TemporalCache& cache, uint32_t width, uint32_t height,
+	Format colorFormat, Format depthFormat, const wchar_t* name)
+{
+	// The history is copied from the targets, so it matches their sizes and formats
+	cache.Color = Texture2D::MakeUnique();
+	N_RETURN(cache.Color->Create(m_device, width, height, colorFormat, 1,
+		ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS, 1, 1, MemoryType::DEFAULT,
+		false, (wstring(name) + L".Color").c_str()), false);
+
+	cache.Depth = Texture2D::MakeUnique();
+	N_RETURN(cache.Depth->Create(m_device, width, height, depthFormat, 1,
+		ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS, 1, 1, MemoryType::DEFAULT,
+		false, (wstring(name) + L".Depth").c_str()), false);
+
+	cache.PrimitiveId = Texture2D::MakeUnique();
+	N_RETURN(cache.PrimitiveId->Create(m_device, width, height, Format::R32_UINT, 1,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS,
+		1, 1, MemoryType::DEFAULT, false, (wstring(name) + L".PrimitiveId").c_str()), false);
+
+	cache.PrevPrimitiveId = Texture2D::MakeUnique();
+	N_RETURN(cache.PrevPrimitiveId->Create(m_device, width, height, Format::R32_UINT, 1,
+		ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS, 1, 1, MemoryType::DEFAULT,
+		false, (wstring(name) + L".PrevPrimitiveId").c_str()), false);
+
 	return true;
 }
 
@@ -279,6 +826,56 @@ DescriptorTableCache& SoftGraphicsPipeline::GetDescriptorTableCache()
 	return *m_descriptorTableCache;
 }
 
+const FrameArena& SoftGraphicsPipeline::GetFrameArena() const
+{
+	return m_frameArena;
+}
+
+const ConstantRing& SoftGraphicsPipeline::GetConstantRing() const
+{
+	return m_constantRing;
+}
+
+uint32_t SoftGraphicsPipeline::GetNumFrameAllocations() const
+{
+	return m_frameArena.GetNumBlockAllocations() + m_rasterGraph.GetNumGrowths();
+}
+
+float SoftGraphicsPipeline::GetBinThreshold() const
+{
+	return m_binThresholdTuner.GetValue();
+}
+
+bool SoftGraphicsPipeline::IsBinThresholdTuning() const
+{
+	return m_binThresholdTuner.IsTuning();
+}
+
+SoftGraphicsPipeline::PassMode SoftGraphicsPipeline::GetPassMode() const
+{
+	return m_passMode;
+}
+
+const SoftGraphicsPipeline::EarlyZStats& SoftGraphicsPipeline::GetEarlyZStats() const
+{
+	return m_earlyZStats;
+}
+
+const SoftGraphicsPipeline::PipelineStats& SoftGraphicsPipeline::GetPipelineStats() const
+{
+	return m_pipelineStats;
+}
+
+const SoftGraphicsPipeline::TemporalCacheStats& SoftGraphicsPipeline::GetTemporalCacheStats() const
+{
+	return m_temporalCacheStats;
+}
+
+uint64_t SoftGraphicsPipeline::GetTransientMemory() const
+{
+	return m_transientMemory;
+}
+
 bool SoftGraphicsPipeline::createPipelines()
 {
 	// Create pipeline layouts
@@ -288,8 +885,24 @@ bool SoftGraphicsPipeline::createPipelines()
 		utilPipelineLayout->SetRange(1, DescriptorType::UAV,
 			7, 0, 0, DescriptorFlag::DESCRIPTORS_VOLATILE |
 			DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		// The cluster order and the early-Z counters, in space 2, are root descriptors
+		utilPipelineLayout->SetRootSRV(2, 0);
+		utilPipelineLayout->SetRootUAV(3, 0, 2);
 		X_RETURN(m_pipelineLayouts[BIN_RASTER], utilPipelineLayout->GetPipelineLayout(
 			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"BinRasterLayout"), false);
+
+		utilPipelineLayout->SetRootCBV(4, 0, 1);
+		X_RETURN(m_pipelineLayouts[BIN_RASTER_MULTI_VIEW], utilPipelineLayout->GetPipelineLayout(
+			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"BinRasterMultiViewLayout"), false);
+
+		// The occlusion-culling variants share the root CBV slot of the multi-view variant
+		utilPipelineLayout->SetRange(5, DescriptorType::UAV, 2, 0, 1,
+			DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		utilPipelineLayout->SetRange(6, DescriptorType::SRV, 1, 0, 1,
+			DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		X_RETURN(m_pipelineLayouts[BIN_RASTER_CULL], utilPipelineLayout->GetPipelineLayout(
+			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"BinRasterCullLayout"), false);
+		m_pipelineLayouts[BIN_RASTER_RETEST] = m_pipelineLayouts[BIN_RASTER_CULL];
 	}
 
 	{
@@ -300,10 +913,39 @@ bool SoftGraphicsPipeline::createPipelines()
 		utilPipelineLayout->SetRange(2, DescriptorType::UAV,
 			5, 0, 0, DescriptorFlag::DESCRIPTORS_VOLATILE |
 			DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		utilPipelineLayout->SetRootUAV(3, 0, 2);
 		X_RETURN(m_pipelineLayouts[TILE_RASTER], utilPipelineLayout->GetPipelineLayout(
 			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"TileRasterLayout"), false);
 	}
 
+	{
+		const auto utilPipelineLayout = Util::PipelineLayout::MakeUnique();
+		utilPipelineLayout->SetConstants(0, 1, 0);
+		utilPipelineLayout->SetRange(1, DescriptorType::UAV, g_hiZLevelsPerPass + 1, 0, 0,
+			DescriptorFlag::DESCRIPTORS_VOLATILE | DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		X_RETURN(m_pipelineLayouts[GEN_HI_Z], utilPipelineLayout->GetPipelineLayout(
+			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"GenHiZLayout"), false);
+	}
+
+	{
+		const auto utilPipelineLayout = Util::PipelineLayout::MakeUnique();
+		utilPipelineLayout->SetConstants(0, 1, 0);
+		utilPipelineLayout->SetRange(1, DescriptorType::UAV, 2, 0, 0,
+			DescriptorFlag::DESCRIPTORS_VOLATILE | DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		X_RETURN(m_pipelineLayouts[GEN_SHADING_RATE], utilPipelineLayout->GetPipelineLayout(
+			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"GenShadingRateLayout"), false);
+	}
+
+	{
+		const auto utilPipelineLayout = Util::PipelineLayout::MakeUnique();
+		utilPipelineLayout->SetConstants(0, SizeOfInUint32(float[2]), 0);
+		utilPipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
+		utilPipelineLayout->SetRange(2, DescriptorType::UAV, 1, 0, 0,
+			DescriptorFlag::DESCRIPTORS_VOLATILE | DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		X_RETURN(m_pipelineLayouts[UPSCALE], utilPipelineLayout->GetPipelineLayout(
+			*m_pipelineLayoutCache, PipelineLayoutFlag::NONE, L"UpscaleLayout"), false);
+	}
+
 	// Create compute pipelines
 	{
 		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, VERTEX_PROCESS, L"VSStage.cso"), false);
@@ -350,6 +992,155 @@ bool SoftGraphicsPipeline::createPipelines()
 		X_RETURN(m_pipelines[PIX_RASTER], state->GetPipeline(*m_computePipelineCache, L"BinRaster"), false);
 	}
 
+	// Depth-only and equal-depth variants
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, VERTEX_DEPTH, L"VSStageDepth.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[VERTEX_DEPTH]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, VERTEX_DEPTH));
+		X_RETURN(m_pipelines[VERTEX_DEPTH], state->GetPipeline(*m_computePipelineCache, L"VertexShaderStageDepth"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, VERTEX_INDEXED_DEPTH, L"VSStageIndexedDepth.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[VERTEX_INDEXED_DEPTH]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, VERTEX_INDEXED_DEPTH));
+		X_RETURN(m_pipelines[VERTEX_INDEXED_DEPTH], state->GetPipeline(*m_computePipelineCache, L"VertexShaderStageIndexedDepth"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, PIX_RASTER_DEPTH, L"PixelRasterDepth.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PIX_RASTER_DEPTH]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, PIX_RASTER_DEPTH));
+		X_RETURN(m_pipelines[PIX_RASTER_DEPTH], state->GetPipeline(*m_computePipelineCache, L"PixelRasterDepth"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, PIX_RASTER_EQUAL, L"PixelRasterEqual.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PIX_RASTER_EQUAL]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, PIX_RASTER_EQUAL));
+		X_RETURN(m_pipelines[PIX_RASTER_EQUAL], state->GetPipeline(*m_computePipelineCache, L"PixelRasterEqual"), false);
+	}
+
+	// Multi-view variants
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, VERTEX_MULTI_VIEW, L"VSStageMultiView.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[VERTEX_MULTI_VIEW]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, VERTEX_MULTI_VIEW));
+		X_RETURN(m_pipelines[VERTEX_MULTI_VIEW], state->GetPipeline(*m_computePipelineCache, L"VertexShaderStageMultiView"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, VERTEX_INDEXED_MULTI_VIEW, L"VSStageIndexedMultiView.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[VERTEX_INDEXED_MULTI_VIEW]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, VERTEX_INDEXED_MULTI_VIEW));
+		X_RETURN(m_pipelines[VERTEX_INDEXED_MULTI_VIEW], state->GetPipeline(*m_computePipelineCache, L"VertexShaderStageIndexedMultiView"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, BIN_RASTER_MULTI_VIEW, L"BinRasterMultiView.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[BIN_RASTER_MULTI_VIEW]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, BIN_RASTER_MULTI_VIEW));
+		X_RETURN(m_pipelines[BIN_RASTER_MULTI_VIEW], state->GetPipeline(*m_computePipelineCache, L"BinRasterMultiView"), false);
+	}
+
+	// Occlusion-culling variants
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, BIN_RASTER_CULL, L"BinRasterCull.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[BIN_RASTER_CULL]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, BIN_RASTER_CULL));
+		X_RETURN(m_pipelines[BIN_RASTER_CULL], state->GetPipeline(*m_computePipelineCache, L"BinRasterCull"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, BIN_RASTER_RETEST, L"BinRasterRetest.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[BIN_RASTER_RETEST]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, BIN_RASTER_RETEST));
+		X_RETURN(m_pipelines[BIN_RASTER_RETEST], state->GetPipeline(*m_computePipelineCache, L"BinRasterRetest"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, GEN_HI_Z, L"GenHiZ.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[GEN_HI_Z]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, GEN_HI_Z));
+		X_RETURN(m_pipelines[GEN_HI_Z], state->GetPipeline(*m_computePipelineCache, L"GenHiZ"), false);
+	}
+
+	// Coarse-shading variants
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, PIX_RASTER_COARSE, L"PixelRasterCoarse.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PIX_RASTER_COARSE]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, PIX_RASTER_COARSE));
+		X_RETURN(m_pipelines[PIX_RASTER_COARSE], state->GetPipeline(*m_computePipelineCache, L"PixelRasterCoarse"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, PIX_RASTER_EQUAL_COARSE, L"PixelRasterEqualCoarse.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PIX_RASTER_EQUAL_COARSE]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, PIX_RASTER_EQUAL_COARSE));
+		X_RETURN(m_pipelines[PIX_RASTER_EQUAL_COARSE], state->GetPipeline(*m_computePipelineCache, L"PixelRasterEqualCoarse"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, GEN_SHADING_RATE, L"GenShadingRate.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[GEN_SHADING_RATE]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, GEN_SHADING_RATE));
+		X_RETURN(m_pipelines[GEN_SHADING_RATE], state->GetPipeline(*m_computePipelineCache, L"GenShadingRate"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, UPSCALE, L"Upscale.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[UPSCALE]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, UPSCALE));
+		X_RETURN(m_pipelines[UPSCALE], state->GetPipeline(*m_computePipelineCache, L"Upscale"), false);
+	}
+
+	// Temporal-cache variants
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, PIX_RASTER_CACHE, L"PixelRasterCache.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PIX_RASTER_CACHE]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, PIX_RASTER_CACHE));
+		X_RETURN(m_pipelines[PIX_RASTER_CACHE], state->GetPipeline(*m_computePipelineCache, L"PixelRasterCache"), false);
+	}
+
+	{
+		N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, PIX_RASTER_EQUAL_CACHE, L"PixelRasterEqualCache.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PIX_RASTER_EQUAL_CACHE]);
+		state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, PIX_RASTER_EQUAL_CACHE));
+		X_RETURN(m_pipelines[PIX_RASTER_EQUAL_CACHE], state->GetPipeline(*m_computePipelineCache, L"PixelRasterEqualCache"), false);
+	}
+
 	return true;
 }
 
@@ -366,6 +1157,9 @@ bool SoftGraphicsPipeline::createResetBuffer(CommandList* pCommandList, vector<R
 	uploaders.push_back(nullptr);
 	N_RETURN(m_binPrimCount->Upload(pCommandList, uploaders.back(), pDataReset, sizeof(uint32_t[3])), false);
 
+	uploaders.push_back(nullptr);
+	N_RETURN(m_rejectedCount->Upload(pCommandList, uploaders.back(), pDataReset, sizeof(uint32_t[3])), false);
+
 	uploaders.push_back(nullptr);
 
 	return m_tilePrimCountReset->Upload(pCommandList, uploaders.back(), pDataReset, sizeof(uint32_t));
@@ -414,39 +1208,195 @@ bool SoftGraphicsPipeline::createDescriptorTables()
 
 	{
 		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		vector<Descriptor> descriptors;
-		descriptors.reserve(7);
-		descriptors.push_back(m_vertexPos->GetUAV()),
-		descriptors.push_back(m_tilePrimCount->GetUAV());
-		descriptors.push_back(m_tilePrimitives->GetUAV());
-		if (m_pDepth)
+		const Descriptor descriptors[] =
 		{
-			descriptors.push_back(m_pDepth->TileZ->GetUAV());
-			descriptors.push_back(m_pDepth->BinZ->GetUAV());
-		}
-		descriptors.push_back(m_binPrimCount->GetUAV());
-		descriptors.push_back(m_binPrimitives->GetUAV());
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(descriptors.size()), descriptors.data());
-		X_RETURN(m_uavTables[UAV_TABLE_RS], descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache), false);
+			m_rejectedClusters->GetUAV(),
+			m_rejectedCount->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		X_RETURN(m_uavTables[UAV_TABLE_CULL], descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache), false);
 	}
 
 	return true;
 }
 
+SoftGraphicsPipeline::ClearInfo& SoftGraphicsPipeline::appendClear()
+{
+	// Clears are recorded per color target, so the capacity is bounded
+	if (!m_pClears) m_pClears = m_frameArena.Allocate<ClearInfo>(MaxRenderTargets);
+	assert(m_numClears < MaxRenderTargets);
+
+	return m_pClears[m_numClears++];
+}
+
+bool SoftGraphicsPipeline::updateDescriptorTable(DescriptorTable& table, ViewKey* pKeys, UtilTable utilTable,
+	uint32_t numDescriptors, const Descriptor* pDescriptors, const ResourceBase* const* ppResources)
+{
+	// The handles and the resources identify the bound views, so the table is only
+	// rebuilt (and looked up in the cache) when any of them changes.
+	auto isDirty = !table;
+	for (auto i = 0u; i < numDescriptors; ++i)
+		isDirty = isDirty || pKeys[i].Descriptor != pDescriptors[i].ptr ||
+			pKeys[i].pResource != ppResources[i]->GetResource().get();
+	if (!isDirty) return false;
+
+	// The cache is keyed on the handles, so its copy is stale if any handle has been
+	// reused for a view of another resource since
+	auto isStale = false;
+	for (auto i = 0u; i < numDescriptors; ++i)
+	{
+		const void* pResource = ppResources[i]->GetResource().get();
+		auto& viewResource = m_viewResources[pDescriptors[i].ptr];
+		isStale = isStale || (viewResource && viewResource != pResource);
+		viewResource = pResource;
+		pKeys[i] = { pDescriptors[i].ptr, pResource };
+	}
+
+	const auto& descriptorTable = m_utilTables[utilTable];
+	descriptorTable->SetDescriptors(0, numDescriptors, pDescriptors);
+	table = descriptorTable->GetCbvSrvUavTable(*m_descriptorTableCache);
+	if (isStale) descriptorTable->CreateCbvSrvUavTable(*m_descriptorTableCache, table);
+
+	return true;
+}
+
+void SoftGraphicsPipeline::updateRasterTables()
+{
+	// The raster stages bind TileZ and BinZ of the current depth buffer amid the lists,
+	// and read its Hi-Z for occlusion culling
+	Descriptor descriptors[7];
+	const ResourceBase* pResources[7];
+	auto numDescriptors = 0u;
+	const auto addUAV = [&](const ResourceBase* pResource, const Descriptor& descriptor)
+	{
+		descriptors[numDescriptors] = descriptor;
+		pResources[numDescriptors++] = pResource;
+	};
+	addUAV(m_vertexPos.get(), m_vertexPos->GetUAV());
+	addUAV(m_tilePrimCount.get(), m_tilePrimCount->GetUAV());
+	addUAV(m_tilePrimitives.get(), m_tilePrimitives->GetUAV());
+	if (m_pDepth)
+	{
+		addUAV(m_pDepth->TileZ.get(), m_pDepth->TileZ->GetUAV());
+		addUAV(m_pDepth->BinZ.get(), m_pDepth->BinZ->GetUAV());
+	}
+	addUAV(m_binPrimCount.get(), m_binPrimCount->GetUAV());
+	addUAV(m_binPrimitives.get(), m_binPrimitives->GetUAV());
+
+	// The util tables only grow, so binding or unbinding the depth needs a new one
+	if (numDescriptors != m_numRsDescriptors)
+	{
+		m_utilTables[UTIL_TABLE_RS] = Util::DescriptorTable::MakeUnique();
+		m_uavTables[UAV_TABLE_RS] = nullptr;
+		m_numRsDescriptors = numDescriptors;
+	}
+	updateDescriptorTable(m_uavTables[UAV_TABLE_RS], m_rsTableKeys, UTIL_TABLE_RS,
+		numDescriptors, descriptors, pResources);
+
+	if (m_pDepth)
+	{
+		const Descriptor hiZDescriptors[] =
+		{
+			m_pDepth->HiZ->GetSRV()
+		};
+		const ResourceBase* const pHiZResources[] = { m_pDepth->HiZ.get() };
+		updateDescriptorTable(m_srvTables[SRV_TABLE_HI_Z], m_srvTableKeys[SRV_TABLE_HI_Z],
+			UTIL_TABLE_HI_Z, static_cast<uint32_t>(size(hiZDescriptors)), hiZDescriptors, pHiZResources);
+	}
+}
+
+void SoftGraphicsPipeline::updateHiZTables()
+{
+	// Each pass reads the last level of the previous pass, or PixelZ, and the trailing
+	// levels of the last pass repeat its last level, which the shader never writes. The
+	// passes are of the same size, so they share a util table.
+	const auto& hiZ = m_pDepth->HiZ;
+	const auto numLevels = getNumHiZLevels();
+	const auto numPasses = DIV_UP(numLevels, g_hiZLevelsPerPass);
+	const auto numDescriptors = g_hiZLevelsPerPass + 1;
+	if (numPasses != m_hiZTables.size())
+	{
+		m_hiZTables.assign(numPasses, nullptr);
+		m_hiZTableKeys.assign(numDescriptors * numPasses, ViewKey());
+	}
+
+	for (auto i = 0u; i < numPasses; ++i)
+	{
+		const auto level = g_hiZLevelsPerPass * i;
+		Descriptor descriptors[numDescriptors];
+		const ResourceBase* pResources[numDescriptors];
+		descriptors[0] = level > 0 ? hiZ->GetUAV(static_cast<uint8_t>(level - 1)) : m_pDepth->PixelZ->GetUAV();
+		pResources[0] = level > 0 ? hiZ.get() : m_pDepth->PixelZ.get();
+		for (auto j = 0u; j < g_hiZLevelsPerPass; ++j)
+		{
+			descriptors[j + 1] = hiZ->GetUAV(static_cast<uint8_t>((min)(level + j, numLevels - 1u)));
+			pResources[j + 1] = hiZ.get();
+		}
+		updateDescriptorTable(m_hiZTables[i], &m_hiZTableKeys[numDescriptors * i],
+			UTIL_TABLE_HI_Z_GEN, numDescriptors, descriptors, pResources);
+	}
+}
+
+void SoftGraphicsPipeline::updateViews()
+{
+	// Map the clip space of each view to its rectangle in the atlas, so that the tile and
+	// pixel rasters need no knowledge of the views. Each draw has its own slice, as the
+	// views may change between the draws of a frame.
+	const auto slice = m_constantRing.Allocate(sizeof(CBViews));
+	assert(slice.pData);
+	m_cbViewsOffset = slice.Offset;
+	const auto pCb = reinterpret_cast<CBViews*>(slice.pData);
+	for (auto i = 0u; i < m_numViews; ++i)
+	{
+		const auto& viewport = m_viewViewports[i];
+		const auto scaleX = viewport.Width / m_viewport.Width;
+		const auto scaleY = viewport.Height / m_viewport.Height;
+		const auto biasX = (2.0f * viewport.TopLeftX + viewport.Width) / m_viewport.Width - 1.0f;
+		const auto biasY = 1.0f - (2.0f * viewport.TopLeftY + viewport.Height) / m_viewport.Height;
+		const auto toAtlas = XMMatrixScaling(scaleX, scaleY, 1.0f) * XMMatrixTranslation(biasX, biasY, 0.0f);
+		XMStoreFloat4x4(&pCb->ViewProjs[i], XMMatrixTranspose(XMLoadFloat4x4(&m_viewProjs[i]) * toAtlas));
+
+		auto& viewBins = pCb->ViewBins[i];
+		viewBins[0] = static_cast<uint32_t>(viewport.TopLeftX) / BIN_SIZE;
+		viewBins[1] = static_cast<uint32_t>(viewport.TopLeftY) / BIN_SIZE;
+		viewBins[2] = DIV_UP(static_cast<uint32_t>(viewport.TopLeftX + viewport.Width), BIN_SIZE);
+		viewBins[3] = DIV_UP(static_cast<uint32_t>(viewport.TopLeftY + viewport.Height), BIN_SIZE);
+	}
+	pCb->NumViews = m_numViews;
+}
+
+void SoftGraphicsPipeline::updateClusterOrder(uint32_t numClusters)
+{
+	// Each frame slot holds an order, in which the clusters are indexed without one set
+	assert(numClusters <= m_maxClusterCount);
+	const auto pOrder = reinterpret_cast<uint32_t*>(m_clusterOrder->Map()) + m_maxClusterCount * m_frameIndex;
+	if (m_pClusterOrder) memcpy(pOrder, m_pClusterOrder, sizeof(uint32_t) * numClusters);
+	else for (auto i = 0u; i < numClusters; ++i) pOrder[i] = i;
+}
+
 void SoftGraphicsPipeline::draw(CommandList* pCommandList, uint32_t num, StageIndex vs)
 {
+	TRACE_SCOPE_INDEX(DRAW, L"Draw", m_numDraws);
+
 	static auto firstTime = true;
 	if (firstTime)
 	{
+		// Each primitive of each view takes at least an entry of the shared tile lists
+		assert(static_cast<uint64_t>(m_maxVertexCount / 3) * m_maxNumViews <= g_tileBufferSize);
 		m_vertexPos = StructuredBuffer::MakeUnique();
-		m_vertexPos->Create(m_device, m_maxVertexCount, sizeof(float[4]),
+		m_vertexPos->Create(m_device, m_maxVertexCount * m_maxNumViews, sizeof(float[4]),
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT,
 			1, nullptr, 1, nullptr, L"VertexPositions");
 
-		m_vertexCompletions = StructuredBuffer::MakeUnique();
-		m_vertexCompletions->Create(m_device, m_maxVertexCount, sizeof(uint32_t),
+		m_maxClusterCount = DIV_UP(m_maxVertexCount / 3, CLUSTER_SIZE);
+		m_rejectedClusters = StructuredBuffer::MakeUnique();
+		m_rejectedClusters->Create(m_device, m_maxClusterCount, sizeof(uint32_t),
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT,
-			1, nullptr, 1, nullptr, L"VertexCompletions");
+			1, nullptr, 1, nullptr, L"RejectedClusters");
+
+		m_clusterOrder = StructuredBuffer::MakeUnique();
+		m_clusterOrder->Create(m_device, m_maxClusterCount * FrameCount, sizeof(uint32_t),
+			ResourceFlag::NONE, MemoryType::UPLOAD, 1, nullptr, 0, nullptr, L"ClusterOrder");
 
 		const auto attribCount = static_cast<uint32_t>(m_vertexAttribs.size());
 		for (auto i = 0u; i < attribCount; ++i)
@@ -459,171 +1409,522 @@ void SoftGraphicsPipeline::draw(CommandList* pCommandList, uint32_t num, StageIn
 				m_attribInfo[i].Name.c_str());
 		}
 
+		// The buffers that only a draw uses, each committed for the lifetime of the pipeline
+		m_transientMemory = sizeof(float[4]) * m_maxVertexCount * m_maxNumViews +
+			sizeof(uint32_t[2]) * (static_cast<uint64_t>(g_tileBufferSize) + g_binBufferSize);
+		for (const auto& attribInfo : m_attribInfo)
+			m_transientMemory += static_cast<uint64_t>(attribInfo.Stride) * m_maxVertexCount;
+
 		createPipelines();
 		createDescriptorTables();
 		firstTime = false;
 	}
 
-	const DescriptorPool descriptorPools[] =
-	{
-		m_descriptorTableCache->GetDescriptorPool(CBV_SRV_UAV_POOL),
-		//m_descriptorTableCache->GetDescriptorPool(SAMPLER_POOL)
-	};
-	pCommandList->SetDescriptorPools(static_cast<uint32_t>(size(descriptorPools)), descriptorPools);
-
-	// Clear depth
-	if (m_pDepth && m_clearDepth != 0xffffffff)
-	{
-		pCommandList->ClearUnorderedAccessViewUint(m_outTables[m_outTables.size() - 1],
-			m_pDepth->PixelZ->GetUAV(), m_pDepth->PixelZ->GetResource(), &m_clearDepth);
-		pCommandList->ClearUnorderedAccessViewUint(m_outTables[m_outTables.size() - 2],
-			m_pDepth->TileZ->GetUAV(), m_pDepth->TileZ->GetResource(), &m_clearDepth);
-#if USE_TRIPPLE_RASTER
-		pCommandList->ClearUnorderedAccessViewUint(m_outTables[m_outTables.size() - 3],
-			m_pDepth->BinZ->GetUAV(), m_pDepth->BinZ->GetResource(), &m_clearDepth);
-#endif
-		m_clearDepth = 0xffffffff;
-	}
-
-	// Set resource barriers and clear
-	ResourceBarrier barrier;
-	// Due to auto promotions, no need to call commandList.Barrier()
-	const uint32_t clearCount = static_cast<uint32_t>(m_clears.size());
-	for (auto i = 0u; i < clearCount; ++i)
-	{
-		m_pColorTarget[i].SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
-		if (m_clears[i].IsUint)
-			pCommandList->ClearUnorderedAccessViewUint(m_outTables[i], m_clears[i].pTarget->GetUAV(),
-				m_clears[i].pTarget->GetResource(), m_clears[i].ClearUint);
-		else pCommandList->ClearUnorderedAccessViewFloat(m_outTables[i], m_clears[i].pTarget->GetUAV(),
-			m_clears[i].pTarget->GetResource(), m_clears[i].ClearFloat);
-	}
-	m_clears.clear();
-
-	m_tilePrimCount->SetBarrier(&barrier, ResourceState::COPY_DEST);
-#if USE_TRIPPLE_RASTER
-	m_binPrimCount->SetBarrier(&barrier, ResourceState::COPY_DEST);
+	// The depth buffer may have changed since the last draw
+	updateRasterTables();
+
+	setDescriptorPools(pCommandList);
+
+	// The clears, the vertex shader and the raster stages are the passes of a graph, see
+	// rasterize(), which derives their barriers
+	const auto multiView = m_passMode == PassMode::DEPTH_MULTI_VIEW;
+	const auto depthOnly = m_passMode == PassMode::DEPTH_ONLY || multiView;
+	assert(!depthOnly || m_pDepth);
+	assert(!multiView || m_numViews > 0);
+	++m_numDraws;
+	if (!depthOnly) ++m_numColorDraws;
+
+	// Rasterizations, the views of each primitive are interleaved
+	const auto numTriangles = multiView ? num / 3 * m_numViews : num / 3;
+	m_trianglesIn[m_frameIndex] += numTriangles;
+	rasterizer(pCommandList, num, numTriangles, vs);
+
+#if EARLY_Z_STATS || PIPELINE_STATS
+	// The copy of the last draw holds the totals of the frame
+	const auto barriers = m_frameArena.Allocate<ResourceBarrier>(1);
+	const auto numBarriers = m_statCounters->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+	pCommandList->CopyBufferRegion(m_statReadback->GetResource(), sizeof(StatCounters) * m_frameIndex,
+		m_statCounters->GetResource(), 0, sizeof(StatCounters));
 #endif
-	for (auto& attrib : m_vertexAttribs)
-		attrib->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
-
-	// Vertex shader
-	{
-		// Set descriptor tables
-		const auto baseIdx = static_cast<uint32_t>(m_extVsTables.size());
-		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[vs]);
-		for (auto i = 0u; i < baseIdx; ++i)
-			pCommandList->SetComputeDescriptorTable(i, m_extVsTables[i]);
-		pCommandList->SetComputeDescriptorTable(baseIdx, m_srvTables[SRV_TABLE_VS]);
-		pCommandList->SetComputeDescriptorTable(baseIdx + 1, m_uavTables[UAV_TABLE_VS]);
-
-		// Set pipeline state
-		pCommandList->SetPipelineState(m_pipelines[vs]);
-
-		// Dispatch
-		pCommandList->Dispatch(DIV_UP(num, 64), 1, 1);
-	}
-
-	// Rasterizations
-	rasterizer(pCommandList, num / 3);
 }
 
-void SoftGraphicsPipeline::rasterizer(CommandList* pCommandList, uint32_t numTriangles)
+void SoftGraphicsPipeline::rasterizer(CommandList* pCommandList, uint32_t numVertices,
+	uint32_t numTriangles, StageIndex vs)
 {
 	CBViewPort cbViewport;
 	cbViewport.TopLeftX = m_viewport.TopLeftX;
 	cbViewport.TopLeftY = m_viewport.TopLeftY;
 	cbViewport.Width = m_viewport.Width;
 	cbViewport.Height = m_viewport.Height;
+	cbViewport.Scissor[0] = 0;
+	cbViewport.Scissor[1] = 0;
+	cbViewport.Scissor[2] = static_cast<uint32_t>(ceil(cbViewport.Width));
+	cbViewport.Scissor[3] = static_cast<uint32_t>(ceil(cbViewport.Height));
+	if (m_isScissorEnabled)
+	{
+		// Clamp the scissor rectangle to the viewport
+		cbViewport.Scissor[0] = (min)(static_cast<uint32_t>((max)(m_scissorRect.left, 0L)), cbViewport.Scissor[2]);
+		cbViewport.Scissor[1] = (min)(static_cast<uint32_t>((max)(m_scissorRect.top, 0L)), cbViewport.Scissor[3]);
+		cbViewport.Scissor[2] = (min)(static_cast<uint32_t>((max)(m_scissorRect.right, 0L)), cbViewport.Scissor[2]);
+		cbViewport.Scissor[3] = (min)(static_cast<uint32_t>((max)(m_scissorRect.bottom, 0L)), cbViewport.Scissor[3]);
+	}
 	cbViewport.NumTileX = static_cast<uint32_t>(ceil(cbViewport.Width / TILE_SIZE));
 	cbViewport.NumTileY = static_cast<uint32_t>(ceil(cbViewport.Height / TILE_SIZE));
 	cbViewport.NumBinX = static_cast<uint32_t>(ceil(cbViewport.Width / BIN_SIZE));
 	cbViewport.NumBinY = static_cast<uint32_t>(ceil(cbViewport.Height / BIN_SIZE));
+	cbViewport.BinThreshold = m_binThresholdTuner.GetValue();
+
+	// The primitives of the views are interleaved, so the multi-view pass has no clusters
+	const auto multiView = m_passMode == PassMode::DEPTH_MULTI_VIEW;
+	if (!multiView) updateClusterOrder(DIV_UP(numTriangles, CLUSTER_SIZE));
 
-	// Reset TilePrimitiveCount
-	pCommandList->CopyBufferRegion(m_tilePrimCount->GetResource(), 0,
-		m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
+	if (!isOcclusionCulling())
+	{
+		rasterize(pCommandList, cbViewport, numVertices, numTriangles, vs,
+			multiView ? BIN_RASTER_MULTI_VIEW : BIN_RASTER);
+
+		return;
+	}
+
+	// Clusters of this frame are reprojected into the Hi-Z of the previous frame
+	const auto slice = m_constantRing.Allocate(sizeof(CBCull));
+	assert(slice.pData);
+	m_cbCullOffset = slice.Offset;
+	const auto pCb = reinterpret_cast<CBCull*>(slice.pData);
+	XMStoreFloat4x4(&pCb->Reprojection, XMMatrixTranspose(XMLoadFloat4x4(&m_reprojection)));
+
+	// Phase 1: rasterize the clusters visible in the Hi-Z of the previous frame
+	rasterize(pCommandList, cbViewport, numVertices, numTriangles, vs, BIN_RASTER_CULL);
+
+	// Phase 2: retest the rejected clusters against the Hi-Z of this frame
+	GenerateHiZ(pCommandList);
+	rasterize(pCommandList, cbViewport, 0, 0, vs, BIN_RASTER_RETEST);
+
+	// Keep the Hi-Z for the next frame
+	GenerateHiZ(pCommandList);
+}
+
+void SoftGraphicsPipeline::rasterize(CommandList* pCommandList, const CBViewPort& cbViewport,
+	uint32_t numVertices, uint32_t numTriangles, StageIndex vs, StageIndex bin)
+{
+	// The retest follows the first phase and the Hi-Z generation within the same draw, so
+	// the clears, the vertex shader and the resets of the counters of the frame only
+	// precede the first phase
+	const auto isRetest = bin == BIN_RASTER_RETEST;
+	const auto isCulling = bin == BIN_RASTER_CULL || isRetest;
+	const auto isFirstDraw = m_numDraws <= 1;
+	const auto depthOnly = m_passMode == PassMode::DEPTH_ONLY || m_passMode == PassMode::DEPTH_MULTI_VIEW;
+	const auto cached = m_pTemporalCache && !depthOnly;
+	const auto coarse = m_pShadingRate && !depthOnly && !cached;
+	const auto isClearingDepth = !isRetest && m_pDepth && m_clearDepth != 0xffffffff;
+	const auto isClearingPrimIds = !isRetest && m_pTemporalCache && m_numClears > 0;
+
+	// The passes only capture the arguments as a whole, which fits the small buffer of
+	// std::function, so rebuilding the graph allocates nothing once it has grown.
+	struct
+	{
+		const CBViewPort& Viewport;
+		uint32_t NumVertices;
+		uint32_t NumTriangles;
+		StageIndex VS;
+		StageIndex Bin;
+		StageIndex PS;
+		bool ResetStats;
+		bool ResetCache;
+	} args = { cbViewport, numVertices, numTriangles, vs, bin, PIX_RASTER,
+		!isRetest && isFirstDraw, !isRetest && isFirstDraw && m_pTemporalCache };
+
+	// The stages declare their accesses, from which the graph derives their barriers.
+	// Due to auto promotions, the resources need no barrier in the first draw of the
+	// frame, but the states no longer decay between the draws of a command list.
+	auto& graph = m_rasterGraph;
+	graph.Reset();
+	const auto isPromoted = isFirstDraw && !isRetest;
+	const auto vertexPos = graph.ImportResource(m_vertexPos.get(), isPromoted);
+	const auto tilePrimCount = graph.ImportResource(m_tilePrimCount.get(), isPromoted);
+	const auto tilePrimitives = graph.ImportResource(m_tilePrimitives.get(), isPromoted);
 #if USE_TRIPPLE_RASTER
-	// Reset BinPrimitiveCount
-	pCommandList->CopyBufferRegion(m_binPrimCount->GetResource(), 0,
-		m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
+	const auto binPrimCount = graph.ImportResource(m_binPrimCount.get(), isPromoted);
+	const auto binPrimitives = graph.ImportResource(m_binPrimitives.get(), isPromoted);
+#endif
+#if EARLY_Z_STATS || PIPELINE_STATS
+	const auto statCounters = graph.ImportResource(m_statCounters.get(), isPromoted);
 #endif
+	const auto cacheCounters = graph.ImportResource(m_cacheCounters.get(), isPromoted);
+	const auto primitiveId = m_pTemporalCache ?
+		graph.ImportResource(m_pTemporalCache->PrimitiveId.get(), isPromoted) : UINT32_MAX;
 
-	// Set resource barriers
-	vector<ResourceBarrier> barriers(m_vertexAttribs.size() + 2);
-	auto numBarriers = m_tilePrimCount->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS);
+	uint32_t colorTargets[MaxRenderTargets];
+	for (auto i = 0u; i < m_numColorTargets; ++i)
+		colorTargets[i] = graph.ImportResource(&m_pColorTarget[i], isPromoted);
+
+	uint32_t pixelZ = UINT32_MAX, tileZ = UINT32_MAX, binZ = UINT32_MAX;
+	if (m_pDepth)
+	{
+		pixelZ = graph.ImportResource(m_pDepth->PixelZ.get(), isPromoted);
+		tileZ = graph.ImportResource(m_pDepth->TileZ.get(), isPromoted);
+		binZ = graph.ImportResource(m_pDepth->BinZ.get(), isPromoted);
+	}
+
+	uint32_t attribs[D3D12_COMPUTE_SHADER_MAX_UAVS];
+	assert(m_vertexAttribs.size() <= size(attribs));
+	const auto numAttribs = depthOnly ? 0 : static_cast<uint32_t>(m_vertexAttribs.size());
+	for (auto i = 0u; i < numAttribs; ++i)
+		attribs[i] = graph.ImportResource(m_vertexAttribs[i].get(), isPromoted);
+
+	if (!isRetest)
+	{
+		// Clear the targets recorded by ClearFloat() and ClearUint(), and the depth
+		if (m_numClears > 0 || isClearingDepth)
+		{
+			const auto clear = graph.AddPass(L"Clear", [this](CommandList* pCmdList)
+			{
+				clearDepth(pCmdList);
+				clearTargets(pCmdList);
+			});
+			for (auto i = 0u; i < m_numClears; ++i) graph.Write(clear, colorTargets[i]);
+			if (isClearingPrimIds) graph.Write(clear, primitiveId);
+			if (isClearingDepth)
+			{
+				graph.Write(clear, pixelZ);
+				graph.Write(clear, tileZ);
+				graph.Write(clear, binZ);
+			}
+		}
+
+		// Vertex shader
+		const auto vertexStage = graph.AddPass(L"VertexShader", [this, &args](CommandList* pCmdList)
+		{
+			vertexShader(pCmdList, args.NumVertices, args.VS);
+		});
+		graph.Write(vertexStage, vertexPos);
+		for (auto i = 0u; i < numAttribs; ++i) graph.Write(vertexStage, attribs[i]);
+	}
+
+	// Reset the counters
+	const auto reset = graph.AddPass(L"ResetCounters", [this, &args](CommandList* pCmdList)
+	{
+		// Reset TilePrimitiveCount
+		pCmdList->CopyBufferRegion(m_tilePrimCount->GetResource(), 0,
+			m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
 #if USE_TRIPPLE_RASTER
-	numBarriers = m_binPrimCount->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS, numBarriers);
+		// Reset BinPrimitiveCount
+		pCmdList->CopyBufferRegion(m_binPrimCount->GetResource(), 0,
+			m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
 #endif
-	pCommandList->Barrier(numBarriers, barriers.data());
-
-	// Due to auto promotions, no need to call commandList.Barrier()
-	m_tilePrimitives->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS);
+		// Reset RejectedClusterCount
+		if (args.Bin == BIN_RASTER_CULL)
+			pCmdList->CopyBufferRegion(m_rejectedCount->GetResource(), 0,
+				m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
+
+		// The counters of the temporal cache and the stats accumulate over the draws of the frame
+		if (args.ResetCache)
+			for (auto i = 0u; i < SizeOfInUint32(TemporalCacheStats); ++i)
+				pCmdList->CopyBufferRegion(m_cacheCounters->GetResource(), sizeof(uint32_t) * i,
+					m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
+#if EARLY_Z_STATS || PIPELINE_STATS
+		if (args.ResetStats)
+			for (auto i = 0u; i < SizeOfInUint32(StatCounters); ++i)
+				pCmdList->CopyBufferRegion(m_statCounters->GetResource(), sizeof(uint32_t) * i,
+					m_tilePrimCountReset->GetResource(), 0, sizeof(uint32_t));
+#endif
+	});
+	graph.Write(reset, tilePrimCount, ResourceState::COPY_DEST);
 #if USE_TRIPPLE_RASTER
-	m_binPrimitives->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS);
+	graph.Write(reset, binPrimCount, ResourceState::COPY_DEST);
+#endif
+	if (args.ResetCache) graph.Write(reset, cacheCounters, ResourceState::COPY_DEST);
+#if EARLY_Z_STATS || PIPELINE_STATS
+	if (args.ResetStats) graph.Write(reset, statCounters, ResourceState::COPY_DEST);
 #endif
 
 	// Bin raster
+	const auto binRaster = graph.AddPass(L"BinRaster", [this, &args](CommandList* pCmdList)
 	{
 		// Set descriptor tables
-		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[BIN_RASTER]);
-		pCommandList->SetCompute32BitConstants(0, SizeOfInUint32(cbViewport), &cbViewport);
-		pCommandList->SetComputeDescriptorTable(1, m_uavTables[UAV_TABLE_RS]);
+		pCmdList->SetComputePipelineLayout(m_pipelineLayouts[args.Bin]);
+		pCmdList->SetCompute32BitConstants(0, SizeOfInUint32(args.Viewport), &args.Viewport);
+		pCmdList->SetComputeDescriptorTable(1, m_uavTables[UAV_TABLE_RS]);
+		pCmdList->SetComputeRootShaderResourceView(2, m_clusterOrder->GetResource(),
+			sizeof(uint32_t) * m_maxClusterCount * m_frameIndex);
+		pCmdList->SetComputeRootUnorderedAccessView(3, m_statCounters->GetResource());
+		if (args.Bin == BIN_RASTER_MULTI_VIEW) pCmdList->SetComputeRootConstantBufferView(4,
+			m_constantRing.GetResource(), m_cbViewsOffset);
+		else if (args.Bin != BIN_RASTER)
+		{
+			pCmdList->SetComputeRootConstantBufferView(4, m_constantRing.GetResource(), m_cbCullOffset);
+			pCmdList->SetComputeDescriptorTable(5, m_uavTables[UAV_TABLE_CULL]);
+			pCmdList->SetComputeDescriptorTable(6, m_srvTables[SRV_TABLE_HI_Z]);
+		}
 
 		// Set pipeline state
-		pCommandList->SetPipelineState(m_pipelines[BIN_RASTER]);
-
-		// Dispatch
-		pCommandList->Dispatch(DIV_UP(numTriangles, 64), 1, 1);
+		pCmdList->SetPipelineState(m_pipelines[args.Bin]);
+
+		// Dispatch a thread group per cluster, the retest only those rejected by the first phase
+		if (args.Bin == BIN_RASTER_RETEST) pCmdList->ExecuteIndirect(m_commandLayout, 1,
+			m_rejectedCount->GetResource(), 0, m_rejectedCount->GetResource());
+		else pCmdList->Dispatch(DIV_UP(args.NumTriangles, CLUSTER_SIZE), 1, 1);
+	});
+	graph.Read(binRaster, vertexPos, ResourceState::UNORDERED_ACCESS);
+	graph.Write(binRaster, tilePrimCount);
+	graph.Write(binRaster, tilePrimitives);
+#if USE_TRIPPLE_RASTER
+	graph.Write(binRaster, binPrimCount);
+	graph.Write(binRaster, binPrimitives);
+#endif
+#if EARLY_Z_STATS || PIPELINE_STATS
+	graph.Write(binRaster, statCounters);
+#endif
+	if (m_pDepth)
+	{
+		graph.Write(binRaster, tileZ);
+		graph.Write(binRaster, binZ);
+	}
+	if (isCulling)
+	{
+		const auto rejectedCount = graph.ImportResource(m_rejectedCount.get());
+		const auto rejectedClusters = graph.ImportResource(m_rejectedClusters.get());
+		if (isRetest)
+		{
+			// The retest consumes the clusters rejected by the first phase
+			graph.Read(binRaster, rejectedCount, ResourceState::INDIRECT_ARGUMENT);
+			graph.Read(binRaster, rejectedClusters, ResourceState::UNORDERED_ACCESS);
+		}
+		else
+		{
+			graph.Write(reset, rejectedCount, ResourceState::COPY_DEST);
+			graph.Write(binRaster, rejectedCount);
+			graph.Write(binRaster, rejectedClusters);
+		}
+		graph.Read(binRaster, graph.ImportResource(m_pDepth->HiZ.get()));
 	}
 
 #if USE_TRIPPLE_RASTER
-	// Set resource barriers
-	numBarriers = m_binPrimCount->SetBarrier(barriers.data(), ResourceState::INDIRECT_ARGUMENT);
-	numBarriers = m_binPrimitives->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
-	pCommandList->Barrier(numBarriers, barriers.data());
-
 	// Tile raster
+	const auto tileRaster = graph.AddPass(L"TileRaster", [this, &args](CommandList* pCmdList)
 	{
 		// Set descriptor tables
-		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[TILE_RASTER]);
-		pCommandList->SetCompute32BitConstants(0, SizeOfInUint32(cbViewport), &cbViewport);
-		pCommandList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_TR]);
-		pCommandList->SetComputeDescriptorTable(2, m_uavTables[UAV_TABLE_RS]);
+		pCmdList->SetComputePipelineLayout(m_pipelineLayouts[TILE_RASTER]);
+		pCmdList->SetCompute32BitConstants(0, SizeOfInUint32(args.Viewport), &args.Viewport);
+		pCmdList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_TR]);
+		pCmdList->SetComputeDescriptorTable(2, m_uavTables[UAV_TABLE_RS]);
+		pCmdList->SetComputeRootUnorderedAccessView(3, m_statCounters->GetResource());
 
 		// Set pipeline state
-		pCommandList->SetPipelineState(m_pipelines[TILE_RASTER]);
+		pCmdList->SetPipelineState(m_pipelines[TILE_RASTER]);
 
 		// Dispatch indirect
-		pCommandList->ExecuteIndirect(m_commandLayout, 1, m_binPrimCount->GetResource(),
+		pCmdList->ExecuteIndirect(m_commandLayout, 1, m_binPrimCount->GetResource(),
 			0, m_binPrimCount->GetResource());
+	});
+	graph.Read(tileRaster, vertexPos, ResourceState::UNORDERED_ACCESS);
+	graph.Read(tileRaster, binPrimCount, ResourceState::INDIRECT_ARGUMENT);
+	graph.Read(tileRaster, binPrimitives);
+	graph.Write(tileRaster, tilePrimCount);
+	graph.Write(tileRaster, tilePrimitives);
+#if EARLY_Z_STATS || PIPELINE_STATS
+	graph.Write(tileRaster, statCounters);
+#endif
+	if (m_pDepth)
+	{
+		graph.Write(tileRaster, tileZ);
+		graph.Write(tileRaster, binZ);
 	}
 #endif
 
-	// Set resource barriers
-	numBarriers = m_tilePrimCount->SetBarrier(barriers.data(), ResourceState::INDIRECT_ARGUMENT);
-	numBarriers = m_tilePrimitives->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
-	for (auto& attrib : m_vertexAttribs)
-		numBarriers = attrib->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
-	pCommandList->Barrier(numBarriers, barriers.data());
-
 	// Pixel raster
+	args.PS = cached ? PIX_RASTER_CACHE : (coarse ? PIX_RASTER_COARSE : PIX_RASTER);
+	if (depthOnly) args.PS = PIX_RASTER_DEPTH;
+	else if (m_passMode == PassMode::DEPTH_EQUAL)
+		args.PS = cached ? PIX_RASTER_EQUAL_CACHE : (coarse ? PIX_RASTER_EQUAL_COARSE : PIX_RASTER_EQUAL);
+	const auto pixRaster = graph.AddPass(L"PixelRaster", [this, &args](CommandList* pCmdList)
 	{
-		// Set descriptor tables
-		const auto baseIdx = static_cast<uint32_t>(m_extPsTables.size());
-		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PIX_RASTER]);
-		for (auto i = 0u; i < baseIdx; ++i)
-			pCommandList->SetComputeDescriptorTable(i, m_extPsTables[i]);
-		pCommandList->SetCompute32BitConstants(baseIdx, SizeOfInUint32(cbViewport), &cbViewport);
-		pCommandList->SetComputeDescriptorTable(baseIdx + 1, m_srvTables[SRV_TABLE_PS]);
-		pCommandList->SetComputeDescriptorTable(baseIdx + 2, m_uavTables[UAV_TABLE_RS]);
-		pCommandList->SetComputeDescriptorTable(baseIdx + 3, m_outTables[0]);
+		pixelRaster(pCmdList, args.Viewport, args.PS);
+	});
+	graph.Read(pixRaster, vertexPos, ResourceState::UNORDERED_ACCESS);
+	graph.Read(pixRaster, tilePrimCount, ResourceState::INDIRECT_ARGUMENT);
+	graph.Read(pixRaster, tilePrimitives);
+#if EARLY_Z_STATS || PIPELINE_STATS
+	graph.Write(pixRaster, statCounters);
+#endif
+	for (auto i = 0u; i < numAttribs; ++i) graph.Read(pixRaster, attribs[i]);
+	if (!depthOnly)
+		for (auto i = 0u; i < m_numColorTargets; ++i) graph.Write(pixRaster, colorTargets[i]);
+	if (m_pDepth)
+	{
+		graph.Write(pixRaster, pixelZ);
+		graph.Write(pixRaster, tileZ);
+		graph.Write(pixRaster, binZ);
+	}
+	if (coarse) graph.Read(pixRaster, graph.ImportResource(m_pShadingRate));
+	if (cached)
+	{
+		auto& cache = *m_pTemporalCache;
+		graph.Read(pixRaster, graph.ImportResource(cache.Color.get()));
+		graph.Read(pixRaster, graph.ImportResource(cache.Depth.get()));
+		graph.Read(pixRaster, graph.ImportResource(cache.PrevPrimitiveId.get()));
+		graph.Write(pixRaster, primitiveId);
+		graph.Write(pixRaster, cacheCounters);
+
+		// Each draw has its own slice, as the draw index differs between the draws of a
+		// frame. Without a valid history, every pixel is refreshed
+		assert(numTriangles <= 1u << CACHE_DRAW_ID_SHIFT);
+		const auto slice = m_constantRing.Allocate(sizeof(CBCache));
+		assert(slice.pData);
+		m_cbCacheOffset = slice.Offset;
+		const auto pCb = reinterpret_cast<CBCache*>(slice.pData);
+		XMStoreFloat4x4(&pCb->Reprojection, XMMatrixTranspose(XMLoadFloat4x4(&m_reprojection)));
+		pCb->RefreshPeriod = m_isCacheHistoryValid ? m_cacheRefreshPeriod : 1;
+		pCb->FrameIdx = m_cacheFrameIdx;
+		pCb->DepthTolerance = g_cacheDepthTolerance;
+		pCb->DrawIdx = m_numDraws - 1;
+	}
 
-		// Set pipeline state
-		pCommandList->SetPipelineState(m_pipelines[PIX_RASTER]);
+	graph.Compile();
+	graph.Execute(pCommandList);
 
-		// Dispatch indirect
-		pCommandList->ExecuteIndirect(m_commandLayout, 1, m_tilePrimCount->GetResource(),
-			0, m_tilePrimCount->GetResource());
+	// Only a single raster pass completes the depth, over which Reshade() can replay it,
+	// and only if no other color draw of the frame needs replaying
+	const auto isComplete = bin == BIN_RASTER && !depthOnly && m_numColorDraws == 1;
+	m_pReshadeDepth = isComplete ? m_pDepth : nullptr;
+	m_reshadeViewport = cbViewport;
+}
+
+void SoftGraphicsPipeline::vertexShader(CommandList* pCommandList, uint32_t numVertices, StageIndex vs)
+{
+	const auto multiView = m_passMode == PassMode::DEPTH_MULTI_VIEW;
+	const auto depthOnly = m_passMode == PassMode::DEPTH_ONLY || multiView;
+
+	// Set descriptor tables
+	const auto baseIdx = static_cast<uint32_t>(m_extVsTables.size());
+	const auto srvTable = vs == VERTEX_INDEXED ? SRV_TABLE_VS_INDEXED : SRV_TABLE_VS;
+	if (multiView) vs = vs == VERTEX_INDEXED ? VERTEX_INDEXED_MULTI_VIEW : VERTEX_MULTI_VIEW;
+	else if (depthOnly) vs = vs == VERTEX_INDEXED ? VERTEX_INDEXED_DEPTH : VERTEX_DEPTH;
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[vs]);
+	setExtBindings(pCommandList, m_extVsTables, m_extVsCbOffsets);
+	pCommandList->SetComputeDescriptorTable(baseIdx, m_srvTables[srvTable]);
+	pCommandList->SetComputeDescriptorTable(baseIdx + 1, m_uavTables[UAV_TABLE_VS]);
+	if (multiView)
+	{
+		updateViews();
+		pCommandList->SetComputeRootConstantBufferView(baseIdx + 2,
+			m_constantRing.GetResource(), m_cbViewsOffset);
+	}
+
+	// Set pipeline state
+	pCommandList->SetPipelineState(m_pipelines[vs]);
+
+	// Dispatch
+	pCommandList->Dispatch(DIV_UP(numVertices, 64), 1, 1);
+}
+
+void SoftGraphicsPipeline::pixelRaster(CommandList* pCommandList, const CBViewPort& cbViewport, StageIndex ps)
+{
+	const auto depthOnly = ps == PIX_RASTER_DEPTH;
+	const auto coarse = ps == PIX_RASTER_COARSE || ps == PIX_RASTER_EQUAL_COARSE;
+	const auto cached = ps == PIX_RASTER_CACHE || ps == PIX_RASTER_EQUAL_CACHE;
+
+	// Set descriptor tables
+	const auto baseIdx = static_cast<uint32_t>(m_extPsTables.size());
+	const auto& outTable = depthOnly ? m_depthOutTable : m_outTable;
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[ps]);
+	setExtBindings(pCommandList, m_extPsTables, m_extPsCbOffsets);
+	pCommandList->SetCompute32BitConstants(baseIdx, SizeOfInUint32(cbViewport), &cbViewport);
+	pCommandList->SetComputeDescriptorTable(baseIdx + 1, m_srvTables[SRV_TABLE_PS]);
+	pCommandList->SetComputeDescriptorTable(baseIdx + 2, m_uavTables[UAV_TABLE_RS]);
+	pCommandList->SetComputeDescriptorTable(baseIdx + 3, outTable);
+	pCommandList->SetComputeRootUnorderedAccessView(baseIdx + 4, m_statCounters->GetResource());
+	if (coarse) pCommandList->SetComputeDescriptorTable(baseIdx + 5, m_srvTables[SRV_TABLE_RATE]);
+	if (cached)
+	{
+		pCommandList->SetComputeDescriptorTable(baseIdx + 6, m_srvTables[SRV_TABLE_CACHE]);
+		pCommandList->SetComputeDescriptorTable(baseIdx + 7, m_uavTables[UAV_TABLE_CACHE]);
+		pCommandList->SetComputeRootConstantBufferView(baseIdx + 8,
+			m_constantRing.GetResource(), m_cbCacheOffset);
 	}
+
+	// Set pipeline state
+	pCommandList->SetPipelineState(m_pipelines[ps]);
+
+	// Dispatch indirect
+	pCommandList->ExecuteIndirect(m_commandLayout, 1, m_tilePrimCount->GetResource(),
+		0, m_tilePrimCount->GetResource());
+}
+
+void SoftGraphicsPipeline::setDescriptorPools(CommandList* pCommandList)
+{
+	const DescriptorPool descriptorPools[] =
+	{
+		m_descriptorTableCache->GetDescriptorPool(CBV_SRV_UAV_POOL),
+		//m_descriptorTableCache->GetDescriptorPool(SAMPLER_POOL)
+	};
+	pCommandList->SetDescriptorPools(static_cast<uint32_t>(size(descriptorPools)), descriptorPools);
+}
+
+void SoftGraphicsPipeline::setExtBindings(CommandList* pCommandList, const vector<DescriptorTable>& tables,
+	const vector<uint32_t>& cbOffsets)
+{
+	for (auto i = 0u; i < tables.size(); ++i)
+	{
+		if (cbOffsets[i] != UINT32_MAX)
+			pCommandList->SetComputeRootConstantBufferView(i, m_constantRing.GetResource(), cbOffsets[i]);
+		else pCommandList->SetComputeDescriptorTable(i, tables[i]);
+	}
+}
+
+void SoftGraphicsPipeline::clearDepth(CommandList* pCommandList)
+{
+	if (!m_pDepth || m_clearDepth == 0xffffffff) return;
+
+	// PixelZ, TileZ and BinZ follow the color targets in the output range
+	const auto depthIdx = m_numColorTargets;
+	pCommandList->ClearUnorderedAccessViewUint(m_outTables[depthIdx],
+		m_pDepth->PixelZ->GetUAV(), m_pDepth->PixelZ->GetResource(), &m_clearDepth);
+	pCommandList->ClearUnorderedAccessViewUint(m_outTables[depthIdx + 1],
+		m_pDepth->TileZ->GetUAV(), m_pDepth->TileZ->GetResource(), &m_clearDepth);
+#if USE_TRIPPLE_RASTER
+	pCommandList->ClearUnorderedAccessViewUint(m_outTables[depthIdx + 2],
+		m_pDepth->BinZ->GetUAV(), m_pDepth->BinZ->GetResource(), &m_clearDepth);
+#endif
+	m_clearDepth = 0xffffffff;
+}
+
+void SoftGraphicsPipeline::clearTargets(CommandList* pCommandList)
+{
+	for (auto i = 0u; i < m_numClears; ++i)
+	{
+		const auto& clear = m_pClears[i];
+		if (clear.IsUint)
+			pCommandList->ClearUnorderedAccessViewUint(m_outTables[i], clear.pTarget->GetUAV(),
+				clear.pTarget->GetResource(), clear.ClearUint);
+		else pCommandList->ClearUnorderedAccessViewFloat(m_outTables[i], clear.pTarget->GetUAV(),
+			clear.pTarget->GetResource(), clear.ClearFloat);
+	}
+
+	// The primitives of the history are told apart by the IDs, which are cleared with target 0
+	if (m_pTemporalCache && m_numClears > 0)
+	{
+		const uint32_t clearValues[] = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+		const auto& primitiveId = *m_pTemporalCache->PrimitiveId;
+		pCommandList->ClearUnorderedAccessViewUint(m_uavTables[UAV_TABLE_CACHE], primitiveId.GetUAV(),
+			primitiveId.GetResource(), clearValues);
+	}
+	m_pClears = nullptr;
+	m_numClears = 0;
+}
+
+uint8_t SoftGraphicsPipeline::getNumHiZLevels() const
+{
+	const auto& hiZ = *m_pDepth->HiZ;
+
+	return static_cast<uint8_t>(log2((max)(hiZ.GetWidth(), hiZ.GetHeight()))) + 1;
+}
+
+bool SoftGraphicsPipeline::isOcclusionCulling() const
+{
+	// The multi-view pass has no Hi-Z of the previous frame, and the equal-depth pass
+	// already has the complete Hi-Z of the prepass.
+	return m_occlusionCulling && m_pDepth && m_passMode != PassMode::DEPTH_MULTI_VIEW &&
+		m_passMode != PassMode::DEPTH_EQUAL;
 }
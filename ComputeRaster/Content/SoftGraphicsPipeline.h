@@ -5,7 +5,10 @@
 #pragma once
 
 #include "Core/XUSG.h"
-#include "SharedConst.h"
+#include "FrameArena.h"
+#include "ConstantRing.h"
+#include "FrameGraph.h"
+#include "AutoTuner.h"
 
 class SoftGraphicsPipeline
 {
@@ -15,32 +18,145 @@ public:
 		XUSG::Texture2D::uptr PixelZ;
 		XUSG::Texture2D::uptr TileZ;
 		XUSG::Texture2D::uptr BinZ;
+		XUSG::Texture2D::uptr HiZ;	// Max-depth mip pyramid of PixelZ, see GenerateHiZ()
+	};
+
+	enum class PassMode : uint8_t
+	{
+		DEFAULT,		// Depth test and write, then shading
+		DEPTH_ONLY,		// Depth prepass without attributes or shading
+		DEPTH_EQUAL,	// Shading of the pixels whose depth equals the prepass depth
+		DEPTH_MULTI_VIEW	// Depth-only pass into the views of an atlas, see SetViews()
+	};
+
+	struct EarlyZStats
+	{
+		uint32_t TilePrims;	// Tile and bin primitives rejected by TileZ and BinZ
+		uint32_t Pixels;	// Pixels rejected by the depth test
+	};
+
+	struct PipelineStats
+	{
+		uint32_t TrianglesIn;		// Of the draws, once per view
+		uint32_t CulledFrustum;
+		uint32_t CulledScissor;
+		uint32_t CulledOcclusion;	// By the cluster culling, see SetOcclusionCulling()
+		uint32_t BinPrims;			// Bin primitives of the tile raster
+		uint32_t TilePrims;			// Tile primitives of the pixel raster
+		uint32_t PixelsTested;		// Covered pixels reaching the depth test
+		uint32_t PixelsPassed;		// Passing the depth test, none in depth-only passes
+		uint32_t PixelsShaded;		// Pixel-shader invocations
+	};
+
+	struct TemporalCache
+	{
+		XUSG::Texture2D::uptr Color;			// Color target 0 of the previous frame
+		XUSG::Texture2D::uptr Depth;			// PixelZ of the previous frame
+		XUSG::Texture2D::uptr PrimitiveId;		// Primitive of each pixel, written by the pixel raster
+		XUSG::Texture2D::uptr PrevPrimitiveId;	// PrimitiveId of the previous frame
+	};
+
+	struct TemporalCacheStats
+	{
+		uint32_t Reused;	// Pixel-shader invocations replaced by the color of the previous frame
+		uint32_t Shaded;	// Pixel-shader invocations on cache misses and refreshes
 	};
 
 	SoftGraphicsPipeline(const XUSG::Device& device);
 	virtual ~SoftGraphicsPipeline();
 
 	bool Init(XUSG::CommandList* pCommandList, std::vector<XUSG::Resource>& uploaders);
+	void BeginFrame(uint32_t frameIndex);
 	bool CreateVertexShaderLayout(XUSG::Util::PipelineLayout* pPipelineLayout,
 		uint32_t slotCount = 0, int32_t srvBindingMax = -1, int32_t uavBindingMax = -1);
 	bool CreatePixelShaderLayout(XUSG::Util::PipelineLayout* pPipelineLayout,
 		bool hasDepth, uint32_t numRTs, uint32_t slotCount = 0, int32_t cbvBindingMax = -1,
 		int32_t srvBindingMax = -1, int32_t uavBindingMax = -1);
 	void SetAttribute(uint32_t i, uint32_t stride, XUSG::Format format, const wchar_t* name = L"Attribute");
-	void SetVertexBuffer(const XUSG::Descriptor& vertexBufferView);
-	void SetIndexBuffer(const XUSG::Descriptor& indexBufferView);
+	void SetVertexBuffer(const XUSG::VertexBuffer& vertexBuffer);
+	void SetIndexBuffer(const XUSG::IndexBuffer& indexBuffer);
 	void SetRenderTargets(uint32_t numRTs, XUSG::Texture2D* pColorTarget, DepthBuffer* pDepth);
 	void SetViewport(const XUSG::Viewport& viewport);
+	// The scissor rectangle, in the pixels of the viewport, bounds the bins, tiles and
+	// pixels of the draws, so that the raster stages cost in proportion to the rectangle.
+	// The primitives outside it are rejected in the bin raster. nullptr scissors to the
+	// viewport.
+	void SetScissorRect(const XUSG::RectRange* pRect);
+	void SetPassMode(PassMode mode);
+	// In multi-view passes, VSMain outputs the world-space position, which is transformed
+	// by the view-projection of each view and rasterized into the bin-aligned rectangle of
+	// the view in the depth atlas. The viewport is that of the whole atlas. The views share
+	// the primitive lists of a single-view draw, so they multiply its list entries.
+	void SetViews(uint32_t numViews, const DirectX::XMFLOAT4X4* pViewProjs, const XUSG::Viewport* pViewports);
+	// Two-phase occlusion culling of clusters: the clusters occluded in the Hi-Z of the
+	// previous frame are skipped, then retested against the Hi-Z of this frame. The
+	// reprojection maps the clip space of this frame to that of the previous frame.
+	void SetOcclusionCulling(bool enable);
+	void SetReprojection(const DirectX::XMFLOAT4X4& reprojection);
+	// The clusters of the draws are dispatched in this order, front to back for the depth
+	// early-outs, or in the index order with nullptr. The order is copied at each draw of
+	// the frame, so it must remain valid until then.
+	void SetClusterOrder(const uint32_t* pClusterOrder);
+	// Coarse pixel shading: each texel of the rate image is the log2 of the coarse block
+	// size of a tile, 0 to 2 for 1x1 to 4x4 pixels, and the pixel raster shades a pixel
+	// of each block and broadcasts its color, while the depth stays per pixel. nullptr
+	// shades every pixel.
+	void SetShadingRateImage(XUSG::Texture2D* pRateImage);
+	// Temporal reprojection cache: the pixel raster reprojects each pixel into the previous
+	// frame by the reprojection of SetReprojection(), and reuses the color there instead of
+	// shading, if the same primitive covered it at the same depth. Every pixel is reshaded
+	// at least once per refresh period, which bounds the staleness of the reused shading
+	// under changes of the pixel-shader inputs. It takes precedence over coarse shading,
+	// and Reshade() bypasses it. nullptr shades every pixel.
+	void SetTemporalCache(TemporalCache* pCache, uint32_t refreshPeriod = 8);
+	void SetBinThreshold(float numTiles);
+	void AutoTuneBinThreshold();
+	void ReportFrameCost(double frameTime);
 	void VSSetDescriptorTable(uint32_t i, const XUSG::DescriptorTable& descriptorTable);
 	void PSSetDescriptorTable(uint32_t i, const XUSG::DescriptorTable& descriptorTable);
+	// Slices of the constant ring for the constants of each draw or frame, valid until the
+	// BeginFrame() of the same frame slot, so they are written every frame. They are bound
+	// to the slots declared by SetRootCBV() in the layouts of the shaders, and the binding
+	// applies to the following draws.
+	ConstantRing::Slice AllocateConstants(uint32_t size);
+	void VSSetConstantBuffer(uint32_t i, const ConstantRing::Slice& slice);
+	void PSSetConstantBuffer(uint32_t i, const ConstantRing::Slice& slice);
 	void ClearFloat(const XUSG::Texture2D& target, const float clearValues[4]);
 	void ClearUint(const XUSG::Texture2D& target, const uint32_t clearValues[4]);
 	void ClearDepth(const float clearValue);
 	void Draw(XUSG::CommandList* pCommandList, uint32_t numVertices);
 	void DrawIndexed(XUSG::CommandList* pCommandList, uint32_t numIndices);
+	// Re-runs only the pixel raster of the last draw with the equal-depth test, reusing its
+	// primitive lists, vertex attributes and depth, for the frames in which only the pixel-
+	// shader inputs and the targets have changed. It fails, leaving it to a full draw,
+	// unless the last draw had a single raster pass that completed the bound depth buffer,
+	// i.e. neither a depth-only nor an occlusion-culled pass, and was the only color draw
+	// of its frame, as the lists of the other draws are gone.
+	bool Reshade(XUSG::CommandList* pCommandList);
+	// Reduces PixelZ of the bound depth buffer into the Hi-Z pyramid, which is left in
+	// the NON_PIXEL_SHADER_RESOURCE state. Level i holds the maximum depth of each
+	// 2^(i+1) x 2^(i+1) pixels; see IsOccludedHiZ() in HiZ.hlsli for the query.
+	void GenerateHiZ(XUSG::CommandList* pCommandList);
+	// Derives the rate image from the curvature of the depth in PixelZ of the bound depth
+	// buffer, see GenShadingRate.hlsl. The rate image is left in the NON_PIXEL_SHADER_RESOURCE
+	// state. It is available after the first draw, which creates the pipelines.
+	void GenerateShadingRate(XUSG::CommandList* pCommandList, XUSG::Texture2D& rateImage, float threshold);
+	// Upscales the width x height sub-rectangle at the top-left of the source to the whole
+	// output with bilinear filtering, for rendering at a dynamic resolution into a sub-
+	// rectangle of the targets. The output is left in the UNORDERED_ACCESS state.
+	void Upscale(XUSG::CommandList* pCommandList, XUSG::Texture2D& source, XUSG::Texture2D& output,
+		uint32_t width, uint32_t height);
+	// Copies color target 0, PixelZ and the primitive IDs into the history of the temporal
+	// cache for the next frame, and the counters of the cache for GetTemporalCacheStats().
+	// Call it after the last draw of the frame.
+	void UpdateTemporalCache(XUSG::CommandList* pCommandList);
 
 	bool CreateDepthBuffer(DepthBuffer &depth, uint32_t width, uint32_t height,
 		XUSG::Format format, const wchar_t* name = L"Depth");
+	bool CreateShadingRateImage(XUSG::Texture2D& rateImage, uint32_t width, uint32_t height,
+		const wchar_t* name = L"ShadingRate");
+	bool CreateTemporalCache(TemporalCache& cache, uint32_t width, uint32_t height,
+		XUSG::Format colorFormat, XUSG::Format depthFormat, const wchar_t* name = L"TemporalCache");
 	bool CreateVertexBuffer(XUSG::CommandList* pCommandList, XUSG::VertexBuffer& vb,
 		std::vector<XUSG::Resource>& uploaders, const void* pData, uint32_t numVert,
 		uint32_t srtide, const wchar_t* name = L"VertexBuffer") const;
@@ -48,8 +164,30 @@ public:
 		std::vector<XUSG::Resource>& uploaders, const void* pData, uint32_t numIdx,
 		XUSG::Format format, const wchar_t* name = L"IndexBuffer");
 	XUSG::DescriptorTableCache& GetDescriptorTableCache();
+	const FrameArena& GetFrameArena() const;
+	const ConstantRing& GetConstantRing() const;
+	// Blocks of the frame arena and growths of the raster graph, which remain constant
+	// once the frames have reached their working set
+	uint32_t GetNumFrameAllocations() const;
+	float GetBinThreshold() const;
+	bool IsBinThresholdTuning() const;
+	PassMode GetPassMode() const;
+	// The counters of the frame slot of BeginFrame(), FrameCount frames behind, which
+	// remain zero unless EARLY_Z_STATS is enabled in SharedConst.h
+	const EarlyZStats& GetEarlyZStats() const;
+	// The counters of the stages of the frame slot of BeginFrame(), FrameCount frames
+	// behind, which remain zero unless PIPELINE_STATS is enabled in SharedConst.h. No
+	// timestamps are queried, so the stages are measured in their work instead.
+	const PipelineStats& GetPipelineStats() const;
+	// The counters of the frame slot of BeginFrame(), FrameCount frames behind
+	const TemporalCacheStats& GetTemporalCacheStats() const;
+	// Memory of the vertex outputs and the primitive lists, which only a draw uses, known
+	// from the first draw on
+	uint64_t GetTransientMemory() const;
 
 	static const uint32_t FrameCount = FRAME_COUNT;
+	static const uint32_t MaxRenderTargets = 8;
+	static const uint32_t MaxViews = MAX_VIEWS;
 
 protected:
 	enum StageIndex : uint8_t
@@ -59,6 +197,22 @@ protected:
 		BIN_RASTER,
 		TILE_RASTER,
 		PIX_RASTER,
+		VERTEX_DEPTH,
+		VERTEX_INDEXED_DEPTH,
+		PIX_RASTER_DEPTH,
+		PIX_RASTER_EQUAL,
+		VERTEX_MULTI_VIEW,
+		VERTEX_INDEXED_MULTI_VIEW,
+		BIN_RASTER_MULTI_VIEW,
+		BIN_RASTER_CULL,
+		BIN_RASTER_RETEST,
+		GEN_HI_Z,
+		PIX_RASTER_COARSE,
+		PIX_RASTER_EQUAL_COARSE,
+		GEN_SHADING_RATE,
+		UPSCALE,
+		PIX_RASTER_CACHE,
+		PIX_RASTER_EQUAL_CACHE,
 
 		NUM_STAGE
 	};
@@ -66,8 +220,13 @@ protected:
 	enum SRVTable : uint8_t
 	{
 		SRV_TABLE_VS,
+		SRV_TABLE_VS_INDEXED,
 		SRV_TABLE_TR,
 		SRV_TABLE_PS,
+		SRV_TABLE_HI_Z,
+		SRV_TABLE_RATE,
+		SRV_TABLE_UPSCALE,
+		SRV_TABLE_CACHE,
 
 		NUM_SRV_TABLE
 	};
@@ -76,20 +235,81 @@ protected:
 	{
 		UAV_TABLE_VS,
 		UAV_TABLE_RS,
+		UAV_TABLE_CULL,
+		UAV_TABLE_RATE,
+		UAV_TABLE_UPSCALE,
+		UAV_TABLE_CACHE,
 
 		NUM_UAV_TABLE
 	};
 
+	enum UtilTable : uint8_t
+	{
+		UTIL_TABLE_VS,
+		UTIL_TABLE_VS_INDEXED,
+		UTIL_TABLE_OUT,
+		UTIL_TABLE_OUT_DEPTH,
+		UTIL_TABLE_RATE,
+		UTIL_TABLE_RATE_GEN,
+		UTIL_TABLE_UPSCALE_SRC,
+		UTIL_TABLE_UPSCALE_DST,
+		UTIL_TABLE_CACHE_SRV,
+		UTIL_TABLE_CACHE_UAV,
+		UTIL_TABLE_RS,
+		UTIL_TABLE_HI_Z,
+		UTIL_TABLE_HI_Z_GEN,
+
+		NUM_UTIL_TABLE
+	};
+
+	// A bound view, identified by its handle and the resource it views, since the handle
+	// of a released view is reused for the next view created
+	struct ViewKey
+	{
+		size_t		Descriptor;
+		const void*	pResource;
+	};
+
+	// Layout of the counters in EarlyZStats.hlsli and PipelineStats.hlsli
+	struct StatCounters
+	{
+		EarlyZStats EarlyZ;
+		PipelineStats Pipeline;
+	};
+
 	struct CBViewPort
 	{
 		float TopLeftX;
 		float TopLeftY;
 		float Width;
 		float Height;
+		uint32_t Scissor[4];	// Left, top, right, bottom
 		uint32_t NumTileX;
 		uint32_t NumTileY;
 		uint32_t NumBinX;
 		uint32_t NumBinY;
+		float BinThreshold;
+	};
+
+	struct CBViews
+	{
+		DirectX::XMFLOAT4X4 ViewProjs[MaxViews];
+		uint32_t ViewBins[MaxViews][4];
+		uint32_t NumViews;
+	};
+
+	struct CBCull
+	{
+		DirectX::XMFLOAT4X4 Reprojection;
+	};
+
+	struct CBCache
+	{
+		DirectX::XMFLOAT4X4 Reprojection;
+		uint32_t RefreshPeriod;
+		uint32_t FrameIdx;
+		float DepthTolerance;
+		uint32_t DrawIdx;
 	};
 
 	struct AttributeInfo
@@ -115,8 +335,29 @@ protected:
 	bool createCommandLayout();
 	bool createDescriptorTables();
 
+	ClearInfo& appendClear();
+	bool updateDescriptorTable(XUSG::DescriptorTable& table, ViewKey* pKeys, UtilTable utilTable,
+		uint32_t numDescriptors, const XUSG::Descriptor* pDescriptors,
+		const XUSG::ResourceBase* const* ppResources);
+
+	void updateRasterTables();
+	void updateHiZTables();
+	void updateViews();
+	void updateClusterOrder(uint32_t numClusters);
 	void draw(XUSG::CommandList* pCommandList, uint32_t num, StageIndex vs);
-	void rasterizer(XUSG::CommandList* pCommandList, uint32_t numTriangles);
+	void rasterizer(XUSG::CommandList* pCommandList, uint32_t numVertices, uint32_t numTriangles, StageIndex vs);
+	void rasterize(XUSG::CommandList* pCommandList, const CBViewPort& cbViewport,
+		uint32_t numVertices, uint32_t numTriangles, StageIndex vs, StageIndex bin);
+	void vertexShader(XUSG::CommandList* pCommandList, uint32_t numVertices, StageIndex vs);
+	void pixelRaster(XUSG::CommandList* pCommandList, const CBViewPort& cbViewport, StageIndex ps);
+	void setDescriptorPools(XUSG::CommandList* pCommandList);
+	void setExtBindings(XUSG::CommandList* pCommandList, const std::vector<XUSG::DescriptorTable>& tables,
+		const std::vector<uint32_t>& cbOffsets);
+	void clearTargets(XUSG::CommandList* pCommandList);
+	void clearDepth(XUSG::CommandList* pCommandList);
+
+	bool isOcclusionCulling() const;
+	uint8_t getNumHiZLevels() const;
 
 	XUSG::Device m_device;
 
@@ -129,14 +370,36 @@ protected:
 	XUSG::Pipeline			m_pipelines[NUM_STAGE];
 	XUSG::CommandLayout		m_commandLayout;
 
-	std::vector<ClearInfo> m_clears;
+	FrameArena				m_frameArena;
+	ConstantRing			m_constantRing;
+	FrameGraph				m_rasterGraph;
+	ClearInfo*				m_pClears;
+	uint32_t				m_numClears;
+	uint32_t				m_numDraws;
+	uint32_t				m_numColorDraws;
+
+	XUSG::Util::DescriptorTable::uptr m_utilTables[NUM_UTIL_TABLE];
+
 	std::vector<XUSG::DescriptorTable> m_extVsTables;
 	std::vector<XUSG::DescriptorTable> m_extPsTables;
-	std::vector<XUSG::DescriptorTable> m_outTables;
+	std::vector<uint32_t> m_extVsCbOffsets;	// In the constant ring, or UINT32_MAX for a table
+	std::vector<uint32_t> m_extPsCbOffsets;
+	std::vector<XUSG::DescriptorTable> m_outTables;	// Of the single views in m_outTable, for the clears
+	XUSG::DescriptorTable	m_outTable;			// Color targets, PixelZ, TileZ and BinZ
+	XUSG::DescriptorTable	m_depthOutTable;	// PixelZ, TileZ and the color targets
+	ViewKey					m_outTableKeys[MaxRenderTargets + 3];
+	ViewKey					m_depthOutTableKeys[MaxRenderTargets + 2];
+	std::unordered_map<size_t, const void*> m_viewResources;	// Last resource of each descriptor handle
 
 	XUSG::DescriptorTable	m_cbvTable;
 	XUSG::DescriptorTable	m_srvTables[NUM_SRV_TABLE];
+	ViewKey					m_srvTableKeys[NUM_SRV_TABLE][3];
 	XUSG::DescriptorTable	m_uavTables[NUM_UAV_TABLE];
+	ViewKey					m_uavTableKeys[NUM_UAV_TABLE][2];
+	ViewKey					m_rsTableKeys[7];
+	uint32_t				m_numRsDescriptors;
+	std::vector<XUSG::DescriptorTable> m_hiZTables;
+	std::vector<ViewKey>	m_hiZTableKeys;		// Of the passes in order, see updateHiZTables()
 	XUSG::DescriptorTable	m_samplerTable;
 
 	XUSG::ConstantBuffer::uptr	m_cbMatrices;
@@ -144,24 +407,64 @@ protected:
 	XUSG::ConstantBuffer::uptr	m_cbPerObject;
 	XUSG::ConstantBuffer::uptr	m_cbBound;
 
-	XUSG::Descriptor		m_vertexBufferView;
-	XUSG::Descriptor		m_indexBufferView;
+	const XUSG::VertexBuffer*	m_pVertexBuffer;
+	const XUSG::IndexBuffer*	m_pIndexBuffer;
 	XUSG::Texture2D*		m_pColorTarget;
 	DepthBuffer*			m_pDepth;
+	XUSG::Texture2D*		m_pShadingRate;
 
 	std::vector<AttributeInfo> m_attribInfo;
 	std::vector<XUSG::TypedBuffer::uptr> m_vertexAttribs;
-	XUSG::StructuredBuffer::uptr	m_vertexCompletions;
 	XUSG::StructuredBuffer::uptr	m_vertexPos;
 	XUSG::StructuredBuffer::uptr	m_tilePrimCountReset;
 	XUSG::StructuredBuffer::uptr	m_binPrimCount;
 	XUSG::StructuredBuffer::uptr	m_binPrimitives;
 	XUSG::StructuredBuffer::uptr	m_tilePrimCount;
 	XUSG::StructuredBuffer::uptr	m_tilePrimitives;
+	XUSG::StructuredBuffer::uptr	m_rejectedClusters;
+	XUSG::StructuredBuffer::uptr	m_rejectedCount;
+	XUSG::StructuredBuffer::uptr	m_clusterOrder;
+	XUSG::StructuredBuffer::uptr	m_statCounters;
+	XUSG::StructuredBuffer::uptr	m_statReadback;
+	XUSG::StructuredBuffer::uptr	m_cacheCounters;
+	XUSG::StructuredBuffer::uptr	m_cacheReadback;
 
 	XUSG::Viewport			m_viewport;
+	XUSG::RectRange			m_scissorRect;
+	bool					m_isScissorEnabled;
+	AutoTuner				m_binThresholdTuner;
+	PassMode				m_passMode;
+
+	DirectX::XMFLOAT4X4		m_viewProjs[MaxViews];
+	XUSG::Viewport			m_viewViewports[MaxViews];
+	uint32_t				m_numViews;
+	uint32_t				m_maxNumViews;
+	uint32_t				m_cbViewsOffset;	// In the constant ring, of the draw
+	uint32_t				m_cbCullOffset;
+	uint32_t				m_cbCacheOffset;
+	uint32_t				m_frameIndex;
+
+	DirectX::XMFLOAT4X4		m_reprojection;
+	bool					m_occlusionCulling;
+
+	const uint32_t*			m_pClusterOrder;
+	EarlyZStats				m_earlyZStats;
+	PipelineStats			m_pipelineStats;
+	uint32_t				m_trianglesIn[FrameCount];	// Counted on the CPU
+
+	TemporalCache*			m_pTemporalCache;
+	TemporalCacheStats		m_temporalCacheStats;
+	uint64_t				m_transientMemory;
+	uint32_t				m_cacheRefreshPeriod;
+	uint32_t				m_cacheFrameIdx;
+	bool					m_isCacheHistoryValid;
 
 	uint32_t				m_maxVertexCount;
+	uint32_t				m_maxClusterCount;
 	uint32_t				m_numColorTargets;
 	uint32_t				m_clearDepth;
+
+	// The raster pass of the last draw, replayed by Reshade()
+	CBViewPort				m_reshadeViewport;
+	const DepthBuffer*		m_pReshadeDepth;
 };
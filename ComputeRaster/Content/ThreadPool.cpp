@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(uint32_t numWorkers) :
+	m_pTask(nullptr),
+	m_generation(0),
+	m_numPending(0),
+	m_numWorkers(numWorkers),
+	m_isExiting(false)
+{
+	if (m_numWorkers == 0) m_numWorkers = (max)(thread::hardware_concurrency(), 1u);
+
+	// The calling thread acts as worker 0
+	m_threads.reserve(m_numWorkers - 1);
+	for (auto i = 1u; i < m_numWorkers; ++i)
+		m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isExiting = true;
+	}
+	m_startCondition.notify_all();
+
+	for (auto& thread : m_threads) thread.join();
+}
+
+void ThreadPool::Execute(const Task& task)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_pTask = &task;
+		m_numPending = m_numWorkers - 1;
+		++m_generation;
+	}
+	m_startCondition.notify_all();
+
+	task(0);
+
+	unique_lock<mutex> lock(m_mutex);
+	m_finishCondition.wait(lock, [this]() { return m_numPending == 0; });
+	m_pTask = nullptr;
+}
+
+uint32_t ThreadPool::GetNumWorkers() const
+{
+	return m_numWorkers;
+}
+
+void ThreadPool::workerLoop(uint32_t workerIdx)
+{
+	uint64_t generation = 0;
+
+	while (true)
+	{
+		const Task* pTask;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_startCondition.wait(lock, [&]() { return m_isExiting || m_generation != generation; });
+			if (m_isExiting) return;
+
+			generation = m_generation;
+			pTask = m_pTask;
+		}
+
+		(*pTask)(workerIdx);
+
+		bool isLast;
+		{
+			lock_guard<mutex> lock(m_mutex);
+			isLast = --m_numPending == 0;
+		}
+		if (isLast) m_finishCondition.notify_one();
+	}
+}
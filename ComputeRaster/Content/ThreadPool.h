@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//--------------------------------------------------------------------------------------
+// Fork-join pool of persistent worker threads for the CPU raster stages.
+// Execute() runs the task once on every worker, the calling thread being
+// worker 0, and returns when all of them have finished.
+//--------------------------------------------------------------------------------------
+class ThreadPool
+{
+public:
+	using Task = std::function<void(uint32_t workerIdx)>;
+
+	ThreadPool(uint32_t numWorkers = 0);
+	virtual ~ThreadPool();
+
+	void Execute(const Task& task);
+
+	uint32_t GetNumWorkers() const;
+
+protected:
+	void workerLoop(uint32_t workerIdx);
+
+	std::vector<std::thread> m_threads;
+	std::mutex				m_mutex;
+	std::condition_variable	m_startCondition;
+	std::condition_variable	m_finishCondition;
+
+	const Task*	m_pTask;
+	uint64_t	m_generation;
+	uint32_t	m_numPending;
+	uint32_t	m_numWorkers;
+	bool		m_isExiting;
+};
@@ -0,0 +1,155 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "TileScheduler.h"
+#include "Tracer.h"
+
+using namespace std;
+
+static inline uint64_t packRange(uint32_t front, uint32_t back)
+{
+	return (static_cast<uint64_t>(back) << 32) | front;
+}
+
+static inline uint32_t getFront(uint64_t range)
+{
+	return static_cast<uint32_t>(range);
+}
+
+static inline uint32_t getBack(uint64_t range)
+{
+	return static_cast<uint32_t>(range >> 32);
+}
+
+TileScheduler::TileScheduler(ThreadPool& threadPool) :
+	m_threadPool(threadPool),
+	m_elapsedTime(0.0)
+{
+	const auto numWorkers = m_threadPool.GetNumWorkers();
+	m_deques = make_unique<Deque[]>(numWorkers);
+	m_workerStats = make_unique<AlignedStats[]>(numWorkers);
+	for (auto i = 0u; i < numWorkers; ++i)
+	{
+		m_deques[i].Range = 0;
+		m_workerStats[i].Stats = {};
+	}
+}
+
+TileScheduler::~TileScheduler()
+{
+}
+
+void TileScheduler::Run(uint32_t numJobs, const Job& job)
+{
+	const auto numWorkers = m_threadPool.GetNumWorkers();
+
+	// Deal the jobs in contiguous ranges to keep neighboring tiles on the same worker
+	for (auto i = 0u; i < numWorkers; ++i)
+	{
+		const auto front = static_cast<uint32_t>(static_cast<uint64_t>(numJobs) * i / numWorkers);
+		const auto back = static_cast<uint32_t>(static_cast<uint64_t>(numJobs) * (i + 1) / numWorkers);
+		m_deques[i].Range.store(packRange(front, back), memory_order_relaxed);
+		m_workerStats[i].Stats = {};
+	}
+
+	const auto start = chrono::steady_clock::now();
+	m_threadPool.Execute([&](uint32_t workerIdx) { runWorker(workerIdx, job); });
+	m_elapsedTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	// Whatever a worker did not spend on jobs, it spent on searching or waiting
+	for (auto i = 0u; i < numWorkers; ++i)
+	{
+		auto& stats = m_workerStats[i].Stats;
+		stats.IdleTime = (max)(m_elapsedTime - stats.BusyTime, 0.0);
+	}
+}
+
+const TileScheduler::WorkerStats& TileScheduler::GetWorkerStats(uint32_t workerIdx) const
+{
+	return m_workerStats[workerIdx].Stats;
+}
+
+uint32_t TileScheduler::GetNumWorkers() const
+{
+	return m_threadPool.GetNumWorkers();
+}
+
+double TileScheduler::GetElapsedTime() const
+{
+	return m_elapsedTime;
+}
+
+void TileScheduler::runWorker(uint32_t workerIdx, const Job& job)
+{
+	auto& stats = m_workerStats[workerIdx].Stats;
+
+	uint32_t jobIdx;
+	while (popFront(workerIdx, jobIdx) || (steal(workerIdx) && popFront(workerIdx, jobIdx)))
+	{
+		TRACE_SCOPE_INDEX(JOB, L"Job", jobIdx);
+		const auto start = chrono::steady_clock::now();
+		job(workerIdx, jobIdx);
+		stats.BusyTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		++stats.NumJobs;
+	}
+}
+
+bool TileScheduler::popFront(uint32_t workerIdx, uint32_t& jobIdx)
+{
+	auto& deque = m_deques[workerIdx];
+	auto range = deque.Range.load(memory_order_acquire);
+
+	// Thieves may shrink the back concurrently
+	while (getFront(range) < getBack(range))
+	{
+		const auto front = getFront(range);
+		if (deque.Range.compare_exchange_weak(range, packRange(front + 1, getBack(range)),
+			memory_order_acq_rel, memory_order_acquire))
+		{
+			jobIdx = front;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool TileScheduler::steal(uint32_t workerIdx)
+{
+	TRACE_SCOPE(STEAL, L"Steal");
+	const auto numWorkers = m_threadPool.GetNumWorkers();
+
+	// Keep searching until every deque is empty
+	auto hasWork = true;
+	while (hasWork)
+	{
+		hasWork = false;
+		for (auto i = 1u; i < numWorkers; ++i)
+		{
+			auto& victim = m_deques[(workerIdx + i) % numWorkers];
+			auto range = victim.Range.load(memory_order_acquire);
+			while (getFront(range) < getBack(range))
+			{
+				hasWork = true;
+
+				// Take the back half, leaving the front to the owner
+				const auto front = getFront(range);
+				const auto back = getBack(range);
+				const auto mid = back - (back - front + 1) / 2;
+				if (victim.Range.compare_exchange_weak(range, packRange(front, mid),
+					memory_order_acq_rel, memory_order_acquire))
+				{
+					// Own deque is empty, and nobody else can refill it
+					m_deques[workerIdx].Range.store(packRange(mid, back), memory_order_release);
+					++m_workerStats[workerIdx].Stats.NumSteals;
+
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include "ThreadPool.h"
+
+//--------------------------------------------------------------------------------------
+// Work-stealing scheduler for the CPU pixel stage. Jobs are dealt to the workers in
+// contiguous ranges; a worker pops jobs from the front of its own deque, and once
+// it runs dry it steals half of the remaining jobs from the back of another deque.
+// Per-worker busy and idle times of the last run are recorded.
+//--------------------------------------------------------------------------------------
+class TileScheduler
+{
+public:
+	using Job = std::function<void(uint32_t workerIdx, uint32_t jobIdx)>;
+
+	struct WorkerStats
+	{
+		double		BusyTime;	// In seconds
+		double		IdleTime;	// In seconds
+		uint32_t	NumJobs;
+		uint32_t	NumSteals;
+	};
+
+	TileScheduler(ThreadPool& threadPool);
+	virtual ~TileScheduler();
+
+	void Run(uint32_t numJobs, const Job& job);
+
+	const WorkerStats& GetWorkerStats(uint32_t workerIdx) const;
+	uint32_t GetNumWorkers() const;
+	double GetElapsedTime() const;
+
+protected:
+	// The job range [front, back) of a deque is packed into one word,
+	// so that both ends are updated with a single compare-exchange.
+	struct alignas(64) Deque
+	{
+		std::atomic<uint64_t> Range;
+	};
+
+	struct alignas(64) AlignedStats
+	{
+		WorkerStats Stats;
+	};
+
+	void runWorker(uint32_t workerIdx, const Job& job);
+	bool popFront(uint32_t workerIdx, uint32_t& jobIdx);
+	bool steal(uint32_t workerIdx);
+
+	ThreadPool&	m_threadPool;
+
+	std::unique_ptr<Deque[]>		m_deques;
+	std::unique_ptr<AlignedStats[]>	m_workerStats;
+
+	double		m_elapsedTime;
+};
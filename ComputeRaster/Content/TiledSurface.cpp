@@ -0,0 +1,147 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "TiledSurface.h"
+
+using namespace std;
+
+TiledSurface::TiledSurface() :
+	m_pData(nullptr),
+	m_clearValue(0),
+	m_layout(Layout::LINEAR),
+	m_width(0),
+	m_height(0),
+	m_numTileX(0),
+	m_numTileY(0),
+	m_pitch(0)
+{
+}
+
+TiledSurface::~TiledSurface()
+{
+}
+
+bool TiledSurface::Create(uint32_t width, uint32_t height, Layout layout)
+{
+	if (width == 0 || height == 0) return false;
+
+	m_layout = layout;
+	m_width = width;
+	m_height = height;
+	m_numTileX = (width + TILE_SIZE - 1) >> TILE_SIZE_LOG;
+	m_numTileY = (height + TILE_SIZE - 1) >> TILE_SIZE_LOG;
+
+	// Both layouts are padded to whole tiles, so that the raster
+	// kernels never need to clip a tile against the surface edges.
+	m_pitch = m_numTileX << TILE_SIZE_LOG;
+	const size_t numTexels = static_cast<size_t>(m_pitch) * (m_numTileY << TILE_SIZE_LOG);
+
+	// Align the texels to the cache lines
+	m_storage.resize(sizeof(uint32_t) * numTexels + CacheLineSize);
+	const auto base = reinterpret_cast<uintptr_t>(m_storage.data());
+	const auto aligned = (base + CacheLineSize - 1) & ~static_cast<uintptr_t>(CacheLineSize - 1);
+	m_pData = reinterpret_cast<uint32_t*>(aligned);
+
+	m_tileCleared.assign(static_cast<size_t>(m_numTileX) * m_numTileY, 0);
+
+	return true;
+}
+
+void TiledSurface::Clear(uint32_t clearValue)
+{
+	const size_t numTexels = static_cast<size_t>(m_pitch) * (m_numTileY << TILE_SIZE_LOG);
+	fill(m_pData, m_pData + numTexels, clearValue);
+	fill(m_tileCleared.begin(), m_tileCleared.end(), 0);
+	m_clearValue = clearValue;
+}
+
+void TiledSurface::FastClear(uint32_t clearValue)
+{
+	// Only the tile flags are written here
+	fill(m_tileCleared.begin(), m_tileCleared.end(), 1);
+	m_clearValue = clearValue;
+}
+
+void TiledSurface::Resolve()
+{
+	for (auto i = 0u; i < m_numTileY; ++i)
+		for (auto j = 0u; j < m_numTileX; ++j)
+			TouchTile(j, i);
+}
+
+void TiledSurface::Detile(void* pDst, uint32_t rowPitch) const
+{
+	for (auto i = 0u; i < m_numTileY; ++i)
+		for (auto j = 0u; j < m_numTileX; ++j)
+			Detile(pDst, rowPitch, j, i);
+}
+
+void TiledSurface::Detile(void* pDst, uint32_t rowPitch, uint32_t tileX, uint32_t tileY) const
+{
+	// Clip the tile to the surface, as the destination is not padded
+	const auto x = tileX << TILE_SIZE_LOG;
+	const auto y = tileY << TILE_SIZE_LOG;
+	const auto width = (min)(m_width - x, static_cast<uint32_t>(TILE_SIZE));
+	const auto height = (min)(m_height - y, static_cast<uint32_t>(TILE_SIZE));
+
+	auto pDstRow = static_cast<uint8_t*>(pDst) + static_cast<size_t>(rowPitch) * y + sizeof(uint32_t) * x;
+	if (IsTileCleared(tileX, tileY))
+	{
+		// Untouched tile, fill the destination with the clear value directly
+		for (auto i = 0u; i < height; ++i)
+		{
+			const auto pDstTexels = reinterpret_cast<uint32_t*>(pDstRow);
+			fill(pDstTexels, pDstTexels + width, m_clearValue);
+			pDstRow += rowPitch;
+		}
+
+		return;
+	}
+
+	const auto pSrc = GetTile(tileX, tileY);
+	const auto srcPitch = GetTileRowPitch();
+	for (auto i = 0u; i < height; ++i)
+	{
+		memcpy(pDstRow, &pSrc[srcPitch * i], sizeof(uint32_t) * width);
+		pDstRow += rowPitch;
+	}
+}
+
+uint32_t TiledSurface::GetClearValue() const
+{
+	return m_clearValue;
+}
+
+TiledSurface::Layout TiledSurface::GetLayout() const
+{
+	return m_layout;
+}
+
+uint32_t TiledSurface::GetWidth() const
+{
+	return m_width;
+}
+
+uint32_t TiledSurface::GetHeight() const
+{
+	return m_height;
+}
+
+uint32_t TiledSurface::GetNumTileX() const
+{
+	return m_numTileX;
+}
+
+uint32_t TiledSurface::GetNumTileY() const
+{
+	return m_numTileY;
+}
+
+void TiledSurface::fillTile(uint32_t tileX, uint32_t tileY, uint32_t value)
+{
+	const auto pTile = GetTile(tileX, tileY);
+	const auto pitch = GetTileRowPitch();
+	for (auto i = 0u; i < TILE_SIZE; ++i)
+		fill(&pTile[pitch * i], &pTile[pitch * i + TILE_SIZE], value);
+}
@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SharedConst.h"
+
+//--------------------------------------------------------------------------------------
+// CPU render surface of 32-bit texels (color in R8G8B8A8, depth as the bits of a
+// float). In the tiled layout, every TILE_SIZE x TILE_SIZE tile is contiguous in
+// memory, so a tile of an 8x8 raster job spans 4 cache lines instead of 8.
+// FastClear() only flags the tiles as cleared; a tile is filled with the clear value
+// the first time the raster touches it, and untouched tiles are filled at resolve.
+//--------------------------------------------------------------------------------------
+class TiledSurface
+{
+public:
+	enum class Layout : uint8_t
+	{
+		LINEAR,
+		TILED
+	};
+
+	TiledSurface();
+	virtual ~TiledSurface();
+
+	bool Create(uint32_t width, uint32_t height, Layout layout = Layout::TILED);
+
+	void Clear(uint32_t clearValue);
+	void FastClear(uint32_t clearValue);
+	void TouchTile(uint32_t tileX, uint32_t tileY);
+	void Resolve();
+
+	void Detile(void* pDst, uint32_t rowPitch) const;
+	void Detile(void* pDst, uint32_t rowPitch, uint32_t tileX, uint32_t tileY) const;
+
+	uint32_t* GetTexel(uint32_t x, uint32_t y);
+	const uint32_t* GetTexel(uint32_t x, uint32_t y) const;
+	uint32_t* GetTile(uint32_t tileX, uint32_t tileY);
+	const uint32_t* GetTile(uint32_t tileX, uint32_t tileY) const;
+	uint32_t GetTileRowPitch() const;
+	uint32_t GetClearValue() const;
+	bool IsTileCleared(uint32_t tileX, uint32_t tileY) const;
+
+	Layout GetLayout() const;
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+	uint32_t GetNumTileX() const;
+	uint32_t GetNumTileY() const;
+
+	static const uint32_t CacheLineSize = 64;
+
+protected:
+	uint32_t getOffset(uint32_t x, uint32_t y) const;
+	void fillTile(uint32_t tileX, uint32_t tileY, uint32_t value);
+
+	std::vector<uint8_t> m_storage;
+	uint32_t*	m_pData;
+
+	// One byte per tile rather than one bit, so that workers owning neighboring tiles
+	// never race on a read-modify-write of the same word. The bytes still share cache
+	// lines, so those workers falsely share them on the first touch of each tile.
+	std::vector<uint8_t> m_tileCleared;
+	uint32_t	m_clearValue;
+
+	Layout		m_layout;
+	uint32_t	m_width;
+	uint32_t	m_height;
+	uint32_t	m_numTileX;
+	uint32_t	m_numTileY;
+	uint32_t	m_pitch;
+};
+
+//--------------------------------------------------------------------------------------
+// Texel addressing is inlined for the raster inner loops.
+//--------------------------------------------------------------------------------------
+inline uint32_t TiledSurface::getOffset(uint32_t x, uint32_t y) const
+{
+	if (m_layout == Layout::LINEAR) return m_pitch * y + x;
+
+	const uint32_t mask = TILE_SIZE - 1;
+	const auto tileIdx = m_numTileX * (y >> TILE_SIZE_LOG) + (x >> TILE_SIZE_LOG);
+
+	return (tileIdx << (TILE_SIZE_LOG * 2)) + ((y & mask) << TILE_SIZE_LOG) + (x & mask);
+}
+
+inline uint32_t* TiledSurface::GetTexel(uint32_t x, uint32_t y)
+{
+	return &m_pData[getOffset(x, y)];
+}
+
+inline const uint32_t* TiledSurface::GetTexel(uint32_t x, uint32_t y) const
+{
+	return &m_pData[getOffset(x, y)];
+}
+
+inline uint32_t* TiledSurface::GetTile(uint32_t tileX, uint32_t tileY)
+{
+	return &m_pData[getOffset(tileX << TILE_SIZE_LOG, tileY << TILE_SIZE_LOG)];
+}
+
+inline const uint32_t* TiledSurface::GetTile(uint32_t tileX, uint32_t tileY) const
+{
+	return &m_pData[getOffset(tileX << TILE_SIZE_LOG, tileY << TILE_SIZE_LOG)];
+}
+
+inline void TiledSurface::TouchTile(uint32_t tileX, uint32_t tileY)
+{
+	// Materialize the pending clear on the first touch
+	auto& isCleared = m_tileCleared[m_numTileX * tileY + tileX];
+	if (isCleared)
+	{
+		fillTile(tileX, tileY, m_clearValue);
+		isCleared = 0;
+	}
+}
+
+inline bool TiledSurface::IsTileCleared(uint32_t tileX, uint32_t tileY) const
+{
+	return m_tileCleared[m_numTileX * tileY + tileX] != 0;
+}
+
+inline uint32_t TiledSurface::GetTileRowPitch() const
+{
+	// Distance in texels between two rows inside a tile
+	return m_layout == Layout::LINEAR ? m_pitch : TILE_SIZE;
+}
@@ -0,0 +1,183 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Tracer.h"
+
+using namespace std;
+
+struct TraceEvent
+{
+	const wchar_t*		Name;
+	int64_t				Begin;	// In nanoseconds since the epoch of the tracer
+	int64_t				End;
+	uint32_t			Index;
+	Tracer::Category	Category;
+};
+
+struct TraceRing
+{
+	TraceEvent			Events[Tracer::RingSize];
+	atomic<uint64_t>	Head;	// Number of the events ever recorded
+	uint32_t			ThreadIdx;
+};
+
+struct TraceState
+{
+	TraceState();
+	~TraceState();
+
+	chrono::steady_clock::time_point Epoch;
+	mutex						Mutex;
+	vector<unique_ptr<TraceRing>> Rings;	// Outlive their threads
+	string						ExitDumpFile;
+};
+
+static const char* g_categoryNames[] = { "Frame", "Draw", "Stage", "Job", "Steal" };
+static_assert(sizeof(g_categoryNames) / sizeof(g_categoryNames[0]) == Tracer::NUM_CATEGORY,
+	"Each category needs a name");
+
+static atomic<bool> g_isEnabled(false);
+static thread_local TraceRing* g_pRing = nullptr;
+
+static bool dump(TraceState& state, const char* fileName);
+
+TraceState::TraceState() :
+	Epoch(chrono::steady_clock::now())
+{
+}
+
+TraceState::~TraceState()
+{
+	if (!ExitDumpFile.empty()) dump(*this, ExitDumpFile.c_str());
+}
+
+static TraceState& getState()
+{
+	// Constructed on the first use, and destroyed at exit after the users of the tracer
+	static TraceState state;
+
+	return state;
+}
+
+static int64_t getTime()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - getState().Epoch).count();
+}
+
+static TraceRing& getRing()
+{
+	// The ring of the thread is created on its first event
+	if (!g_pRing)
+	{
+		auto& state = getState();
+		lock_guard<mutex> lock(state.Mutex);
+		state.Rings.emplace_back(make_unique<TraceRing>());
+		g_pRing = state.Rings.back().get();
+		g_pRing->Head.store(0, memory_order_relaxed);
+		g_pRing->ThreadIdx = static_cast<uint32_t>(state.Rings.size() - 1);
+	}
+
+	return *g_pRing;
+}
+
+static void writeName(ofstream& stream, const wchar_t* name)
+{
+	// The names are plain literals, so the characters beyond ASCII are replaced
+	for (auto c = name; *c; ++c)
+	{
+		if (*c == L'"' || *c == L'\\') stream << '\\' << static_cast<char>(*c);
+		else stream << (*c >= 0x20 && *c < 0x7f ? static_cast<char>(*c) : '?');
+	}
+}
+
+static bool dump(TraceState& state, const char* fileName)
+{
+	ofstream stream(fileName);
+	if (!stream) return false;
+
+	lock_guard<mutex> lock(state.Mutex);
+
+	// Complete events, with the times in microseconds
+	stream << "{\"traceEvents\":[";
+	auto isFirst = true;
+	for (const auto& pRing : state.Rings)
+	{
+		const auto head = pRing->Head.load(memory_order_acquire);
+		const auto tail = head > Tracer::RingSize ? head - Tracer::RingSize : 0;
+		for (auto i = tail; i < head; ++i)
+		{
+			const auto& event = pRing->Events[i % Tracer::RingSize];
+			const auto duration = event.End - event.Begin;
+			stream << (isFirst ? "\n" : ",\n") << "{\"name\":\"";
+			writeName(stream, event.Name);
+			stream << "\",\"cat\":\"" << g_categoryNames[event.Category] << "\",\"ph\":\"X\"";
+			stream << ",\"ts\":" << event.Begin / 1000 << '.' << event.Begin % 1000 / 100;
+			stream << ",\"dur\":" << duration / 1000 << '.' << duration % 1000 / 100;
+			stream << ",\"pid\":0,\"tid\":" << pRing->ThreadIdx;
+			if (event.Index != UINT32_MAX) stream << ",\"args\":{\"index\":" << event.Index << "}";
+			stream << "}";
+			isFirst = false;
+		}
+	}
+	stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return !stream.fail();
+}
+
+Tracer::Scope::Scope(Category category, const wchar_t* name, uint32_t index) :
+	m_name(name),
+	m_begin(0),
+	m_index(index),
+	m_category(category),
+	m_isRecording(g_isEnabled.load(memory_order_relaxed))
+{
+	if (m_isRecording) m_begin = getTime();
+}
+
+Tracer::Scope::~Scope()
+{
+	if (!m_isRecording) return;
+
+	// Only this thread writes its ring, so the head is published without an atomic add
+	auto& ring = getRing();
+	const auto head = ring.Head.load(memory_order_relaxed);
+	auto& event = ring.Events[head % RingSize];
+	event.Name = m_name;
+	event.Begin = m_begin;
+	event.End = getTime();
+	event.Index = m_index;
+	event.Category = m_category;
+	ring.Head.store(head + 1, memory_order_release);
+}
+
+void Tracer::SetEnabled(bool enable)
+{
+	// Set the epoch before the first event
+	getState();
+	g_isEnabled.store(enable, memory_order_relaxed);
+}
+
+bool Tracer::IsEnabled()
+{
+	return g_isEnabled.load(memory_order_relaxed);
+}
+
+bool Tracer::Dump(const char* fileName)
+{
+	return dump(getState(), fileName);
+}
+
+void Tracer::SetExitDumpFile(const char* fileName)
+{
+	auto& state = getState();
+	lock_guard<mutex> lock(state.Mutex);
+	state.ExitDumpFile = fileName ? fileName : "";
+}
@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+// Compile the trace scopes in, which still record nothing until Tracer::SetEnabled()
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS	1
+#endif
+
+//--------------------------------------------------------------------------------------
+// Tracer of the CPU execution of the pipelines, recording scoped events into a ring
+// buffer per thread. Only its owner thread writes a ring, so recording takes neither
+// atomics read-modify-writes nor mutexes, and the oldest events of a thread are
+// overwritten when its ring is full. Dump() writes the events as Chrome trace JSON,
+// which chrome://tracing and ui.perfetto.dev load.
+//--------------------------------------------------------------------------------------
+class Tracer
+{
+public:
+	enum Category : uint8_t
+	{
+		FRAME,
+		DRAW,
+		STAGE,
+		JOB,
+		STEAL,
+
+		NUM_CATEGORY
+	};
+
+	// Records the event of its lifetime, if the tracer is enabled at its construction.
+	// The name must outlive the tracer, e.g. a string literal.
+	class Scope
+	{
+	public:
+		Scope(Category category, const wchar_t* name, uint32_t index = UINT32_MAX);
+		~Scope();
+
+	protected:
+		const wchar_t*	m_name;
+		int64_t			m_begin;
+		uint32_t		m_index;
+		Category		m_category;
+		bool			m_isRecording;
+	};
+
+	static void SetEnabled(bool enable);
+	static bool IsEnabled();
+	// The events are consistent unless a thread records meanwhile
+	static bool Dump(const char* fileName);
+	// Dumps the events when the process exits, if the file name is not empty
+	static void SetExitDumpFile(const char* fileName);
+
+	static const uint32_t RingSize = 1 << 14;	// Events per thread
+};
+
+#if TRACE_EVENTS
+#define TRACE_CONCAT_(a, b)	a##b
+#define TRACE_CONCAT(a, b)	TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(category, name) \
+	Tracer::Scope TRACE_CONCAT(traceScope, __LINE__)(Tracer::category, name)
+#define TRACE_SCOPE_INDEX(category, name, index) \
+	Tracer::Scope TRACE_CONCAT(traceScope, __LINE__)(Tracer::category, name, index)
+#else
+#define TRACE_SCOPE(category, name)
+#define TRACE_SCOPE_INDEX(category, name, index)
+#endif
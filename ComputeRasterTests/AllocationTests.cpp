@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FrameArena.h"
+#include "FrameGraph.h"
+#include "Tests.h"
+
+using namespace std;
+using namespace XUSG;
+
+// Frames rendered before the working set is expected to be reached
+static const uint32_t g_warmUpFrames = FrameArena::FrameCount * 2;
+
+static bool isAligned(const void* p, size_t alignment)
+{
+	return reinterpret_cast<uintptr_t>(p) % alignment == 0;
+}
+
+TEST_CASE(FrameArenaSteadyState)
+{
+	FrameArena arena(1024);
+
+	uint64_t numAllocations = 0;
+	uint32_t numBlocks = 0;
+	for (auto i = 0u; i < g_warmUpFrames * 2; ++i)
+	{
+		if (i == g_warmUpFrames)
+		{
+			numAllocations = Tests::GetNumAllocations();
+			numBlocks = arena.GetNumBlockAllocations();
+		}
+
+		// Requests larger than a block, and more than a block per frame. The blocks are
+		// reused from the second frame of each slot on, where the alignments must still
+		// hold for the addresses, not only for the offsets into the blocks.
+		arena.Reset(i % FrameArena::FrameCount);
+		TEST_CHECK(isAligned(arena.Allocate<uint32_t>(100), alignof(uint32_t)));
+		TEST_CHECK(isAligned(arena.Allocate(1, 1), 1));
+		TEST_CHECK(isAligned(arena.Allocate<uint64_t>(300), alignof(uint64_t)));
+		TEST_CHECK(isAligned(arena.Allocate(4096, 256), 256));
+		TEST_CHECK(isAligned(arena.Allocate(100, 64), 64));
+		TEST_CHECK(arena.GetUsedSize() == sizeof(uint32_t[100]) + 1 + sizeof(uint64_t[300]) + 4096 + 100);
+	}
+
+	TEST_CHECK(arena.GetNumBlockAllocations() == numBlocks);
+	TEST_CHECK(Tests::GetNumAllocations() == numAllocations);
+}
+
+TEST_CASE(FrameGraphRebuildSteadyState)
+{
+	// Rebuilds the graph of SoftGraphicsPipeline::rasterize() per frame, with passes
+	// capturing the pipeline and the arguments of the draw like it does
+	struct Args
+	{
+		uint32_t NumTriangles;
+		uint32_t NumDispatches;
+	} args = {};
+
+	FrameGraph graph;
+	uint64_t numAllocations = 0;
+	uint32_t numGrowths = 0;
+	for (auto i = 0u; i < g_warmUpFrames * 2; ++i)
+	{
+		if (i == g_warmUpFrames)
+		{
+			numAllocations = Tests::GetNumAllocations();
+			numGrowths = graph.GetNumGrowths();
+		}
+
+		graph.Reset();
+		const auto primCount = graph.ImportResource();
+		const auto primitives = graph.ImportResource();
+		const auto attrib = graph.ImportResource();
+		const auto pArgs = &args;
+
+		const auto reset = graph.AddPass(L"ResetCounters", [pArgs](CommandList*) { pArgs->NumTriangles = 0; });
+		graph.Write(reset, primCount, ResourceState::COPY_DEST);
+
+		const auto binRaster = graph.AddPass(L"BinRaster", [pArgs, &args](CommandList*)
+		{
+			args.NumTriangles += 100;
+			++pArgs->NumDispatches;
+		});
+		graph.Write(binRaster, primCount);
+		graph.Write(binRaster, primitives);
+
+		const auto pixelRaster = graph.AddPass(L"PixelRaster", [pArgs, &args](CommandList*)
+		{
+			args.NumDispatches += pArgs->NumTriangles > 0 ? 1 : 0;
+		});
+		graph.Read(pixelRaster, primCount, ResourceState::INDIRECT_ARGUMENT);
+		graph.Read(pixelRaster, primitives);
+		graph.Read(pixelRaster, attrib);
+
+		graph.Compile();
+		graph.Execute(nullptr);
+		TEST_CHECK(graph.GetNumLevels() == 3);
+	}
+
+	TEST_CHECK(args.NumDispatches == g_warmUpFrames * 4);
+	TEST_CHECK(graph.GetNumGrowths() == numGrowths);
+	TEST_CHECK(Tests::GetNumAllocations() == numAllocations);
+}
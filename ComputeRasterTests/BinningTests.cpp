@@ -0,0 +1,198 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "BinEngine.h"
+#include "Tests.h"
+
+using namespace std;
+using namespace DirectX;
+
+// Screen-space vertices of a triangle, in the convention of the viewport transform
+struct ScreenTriangle
+{
+	float X[3];
+	float Y[3];
+};
+
+static void toScreen(ScreenTriangle& tri, const XMFLOAT4* pVertexPos, float width, float height)
+{
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto& v = pVertexPos[i];
+		tri.X[i] = (v.x / v.w + 1.0f) * 0.5f * width;
+		tri.Y[i] = (1.0f - v.y / v.w) * 0.5f * height;
+	}
+}
+
+// Twice the signed area of (a, b, p), positive for the front faces of the viewport
+static float edge(float ax, float ay, float bx, float by, float px, float py)
+{
+	return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+// Random triangles in clip space, partly off screen and of both windings, followed by
+// tiny front faces that only cover pixel centers of the last row and column
+static void createTriangles(vector<XMFLOAT4>& vertexPos, uint32_t numTriangles, uint32_t seed,
+	float width, float height)
+{
+	mt19937 rng(seed);
+	uniform_real_distribution<float> center(-1.2f, 1.2f), extent(-0.6f, 0.6f), depth(0.1f, 0.9f);
+	vertexPos.resize(numTriangles * 3);
+	for (auto i = 0u; i < numTriangles; ++i)
+	{
+		// Every 16th triangle spans most of the screen
+		const auto scale = i % 16 ? 0.2f : 3.0f;
+		const auto x = center(rng);
+		const auto y = center(rng);
+		for (uint8_t j = 0; j < 3; ++j)
+			vertexPos[i * 3 + j] = XMFLOAT4(x + extent(rng) * scale, y + extent(rng) * scale, depth(rng), 1.0f);
+	}
+
+	const XMFLOAT2 edgeCenters[] =
+	{
+		XMFLOAT2(width * 0.5f, height - 0.5f),
+		XMFLOAT2(width - 0.5f, height * 0.5f),
+		XMFLOAT2(width - 0.5f, height - 0.5f)
+	};
+	for (const auto& c : edgeCenters)
+	{
+		const float sx[] = { c.x - 0.4f, c.x + 0.4f, c.x };
+		const float sy[] = { c.y - 0.3f, c.y - 0.3f, c.y + 0.4f };
+		const auto isFront = edge(sx[0], sy[0], sx[1], sy[1], sx[2], sy[2]) > 0.0f;
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			const auto k = isFront ? j : 2 - j;
+			vertexPos.emplace_back(sx[k] / width * 2.0f - 1.0f, 1.0f - sy[k] / height * 2.0f, 0.5f, 1.0f);
+		}
+	}
+}
+
+// Independent of the setup of BinEngine: a front face must be in the list of each bin
+// in which it strictly covers a pixel center, and may only be in the lists of the bins
+// of its bounding box, clamped to the viewport. Those lists keep the submission order.
+static bool isConsistentWithCoverage(const BinEngine& binEngine, const vector<XMFLOAT4>& vertexPos,
+	float width, float height, uint32_t largePrimThreshold)
+{
+	const auto binSizeLog = binEngine.GetBinSizeLog();
+	const auto numBinX = binEngine.GetNumBinX();
+	const auto numBinY = binEngine.GetNumBinY();
+	if (numBinX != static_cast<uint32_t>(ceilf(width / (1 << binSizeLog)))) return false;
+	if (numBinY != static_cast<uint32_t>(ceilf(height / (1 << binSizeLog)))) return false;
+
+	const auto numTriangles = static_cast<uint32_t>(vertexPos.size() / 3);
+	vector<uint8_t> isListed(numBinX * numBinY);
+	vector<uint32_t> largeCounts(numBinX * numBinY, 0);
+	auto numBinPrims = 0u;
+	for (auto i = 0u; i < numBinX * numBinY; ++i)
+	{
+		uint32_t numPrims;
+		const auto pPrims = binEngine.GetBinPrimitives(i, numPrims);
+		for (auto j = 1u; j < numPrims; ++j) if (pPrims[j] <= pPrims[j - 1]) return false;
+		for (auto j = 0u; j < numPrims; ++j) if (pPrims[j] >= numTriangles) return false;
+		numBinPrims += numPrims;
+	}
+	if (binEngine.GetNumBinPrimitives() != numBinPrims) return false;
+
+	for (auto primId = 0u; primId < numTriangles; ++primId)
+	{
+		ScreenTriangle tri;
+		toScreen(tri, &vertexPos[primId * 3], width, height);
+		const auto area = edge(tri.X[0], tri.Y[0], tri.X[1], tri.Y[1], tri.X[2], tri.Y[2]);
+
+		// Bins of the bounding box
+		const auto minX = (max)(*min_element(tri.X, tri.X + 3), 0.0f);
+		const auto minY = (max)(*min_element(tri.Y, tri.Y + 3), 0.0f);
+		const auto maxX = (min)(*max_element(tri.X, tri.X + 3), width);
+		const auto maxY = (min)(*max_element(tri.Y, tri.Y + 3), height);
+		const auto isOnScreen = area > 0.0f && minX <= maxX && minY <= maxY;
+		auto minBinX = 0u, minBinY = 0u, maxBinX = 0u, maxBinY = 0u;
+		if (isOnScreen)
+		{
+			minBinX = (min)(static_cast<uint32_t>(minX) >> binSizeLog, numBinX - 1);
+			minBinY = (min)(static_cast<uint32_t>(minY) >> binSizeLog, numBinY - 1);
+			maxBinX = (min)(static_cast<uint32_t>(maxX) >> binSizeLog, numBinX - 1);
+			maxBinY = (min)(static_cast<uint32_t>(maxY) >> binSizeLog, numBinY - 1);
+		}
+		const auto numAabbBins = (maxBinX - minBinX + 1) * (maxBinY - minBinY + 1);
+		const auto isLarge = numAabbBins > 1 && numAabbBins > largePrimThreshold;
+
+		// The lists of the bins, which hold the primitive
+		for (auto i = 0u; i < numBinX * numBinY; ++i)
+		{
+			uint32_t numPrims;
+			const auto pPrims = binEngine.GetBinPrimitives(i, numPrims);
+			isListed[i] = binary_search(pPrims, pPrims + numPrims, primId);
+			if (!isListed[i]) continue;
+
+			const auto binX = i % numBinX;
+			const auto binY = i / numBinX;
+			if (!isOnScreen || binX < minBinX || binX > maxBinX || binY < minBinY || binY > maxBinY) return false;
+			if (isLarge) ++largeCounts[i];
+		}
+		if (!isOnScreen) continue;
+
+		// Every pixel center strictly inside
+		const auto endX = (min)(static_cast<uint32_t>(ceilf(maxX)), static_cast<uint32_t>(width));
+		const auto endY = (min)(static_cast<uint32_t>(ceilf(maxY)), static_cast<uint32_t>(height));
+		for (auto y = static_cast<uint32_t>(minY); y < endY; ++y)
+		{
+			for (auto x = static_cast<uint32_t>(minX); x < endX; ++x)
+			{
+				const auto px = x + 0.5f;
+				const auto py = y + 0.5f;
+				const auto isCovered = edge(tri.X[0], tri.Y[0], tri.X[1], tri.Y[1], px, py) > 0.0f &&
+					edge(tri.X[1], tri.Y[1], tri.X[2], tri.Y[2], px, py) > 0.0f &&
+					edge(tri.X[2], tri.Y[2], tri.X[0], tri.Y[0], px, py) > 0.0f;
+				if (isCovered && !isListed[numBinX * (y >> binSizeLog) + (x >> binSizeLog)]) return false;
+			}
+		}
+	}
+
+	for (auto i = 0u; i < numBinX * numBinY; ++i)
+		if (binEngine.GetNumLargePrimitives(i) != largeCounts[i]) return false;
+
+	return true;
+}
+
+TEST_CASE(BinEngineMatchesCoverage)
+{
+	// The viewport is no multiple of the bin sizes, so the last bins are partial
+	const auto width = 333.0f;
+	const auto height = 210.0f;
+	const auto largePrimThreshold = 8u;
+
+	ThreadPool threadPool(4);
+	BinEngine binEngine(threadPool);
+	binEngine.SetViewport(width, height);
+	binEngine.SetLargePrimitiveThreshold(largePrimThreshold);
+
+	vector<XMFLOAT4> vertexPos;
+	for (auto binSizeLog = BinEngine::MinBinSizeLog; binSizeLog <= BinEngine::MaxBinSizeLog; ++binSizeLog)
+	{
+		TEST_CHECK(binEngine.SetBinSizeLog(binSizeLog));
+
+		// Fewer triangles than workers, and enough to chain several chunks per bin
+		const uint32_t triangleCounts[] = { 3, 2000 };
+		for (const auto numTriangles : triangleCounts)
+		{
+			createTriangles(vertexPos, numTriangles, binSizeLog * numTriangles, width, height);
+			binEngine.Bin(vertexPos.data(), static_cast<uint32_t>(vertexPos.size() / 3));
+			TEST_CHECK(binEngine.GetBinSizeLog() == binSizeLog);
+			TEST_CHECK(isConsistentWithCoverage(binEngine, vertexPos, width, height, largePrimThreshold));
+		}
+	}
+}
+
+TEST_CASE(BinEngineRejectsUnsupportedBinSizes)
+{
+	ThreadPool threadPool(2);
+	BinEngine binEngine(threadPool);
+	binEngine.SetViewport(256.0f, 256.0f);
+	const auto binSizeLog = binEngine.GetBinSizeLog();
+
+	TEST_CHECK(!binEngine.SetBinSizeLog(BinEngine::MinBinSizeLog - 1));
+	TEST_CHECK(!binEngine.SetBinSizeLog(BinEngine::MaxBinSizeLog + 1));
+	TEST_CHECK(binEngine.GetBinSizeLog() == binSizeLog);
+	TEST_CHECK(binEngine.GetNumBinX() == 256u >> binSizeLog);
+}
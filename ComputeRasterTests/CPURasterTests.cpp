@@ -0,0 +1,207 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CPUFramePipeline.h"
+#include "FrameGraph.h"
+#include "Tests.h"
+
+using namespace std;
+using namespace DirectX;
+
+// The viewport is no multiple of the bins, so the last bins and tiles are partial
+static const uint32_t g_width = 300;
+static const uint32_t g_height = 200;
+static const uint32_t g_numFrames = 6;
+
+struct RasterSettings
+{
+	uint32_t TileSizeLog;
+	uint32_t TileToBinLog;
+	uint32_t SplitThreshold;	// In bins
+};
+
+// The defaults, the smallest bins, whose split jobs are clamped to the surface tiles,
+// and the largest bins, each with most bins split
+static const RasterSettings g_settings[] =
+{
+	{ TILE_SIZE_LOG, TILE_TO_BIN_LOG, UINT32_MAX },
+	{ 2, 2, 4 },
+	{ 3, 2, 4 },
+	{ 4, 3, 2 }
+};
+
+// A fixed scene per frame: small triangles over and beyond the screen, with a few
+// spanning most of it to make the bins split
+static uint32_t createScene(vector<XMFLOAT4>& vertexPos, uint32_t frameIdx)
+{
+	const auto numTriangles = 1000u;
+	mt19937 rng(frameIdx);
+	uniform_real_distribution<float> center(-1.2f, 1.2f), extent(-0.3f, 0.3f), depth(0.1f, 0.9f);
+	vertexPos.resize(numTriangles * 3);
+	for (auto i = 0u; i < numTriangles; ++i)
+	{
+		const auto scale = i % 50 ? 1.0f : 8.0f;
+		const auto x = center(rng);
+		const auto y = center(rng);
+		for (uint8_t j = 0; j < 3; ++j)
+			vertexPos[i * 3 + j] = XMFLOAT4(x + extent(rng) * scale, y + extent(rng) * scale, depth(rng), 1.0f);
+	}
+
+	return numTriangles;
+}
+
+static CPURasterizer::PixelShader createPixelShader(uint32_t frameIdx)
+{
+	return [frameIdx](const CPURasterizer::PixelInput& input) { return input.PrimId * 7 + frameIdx; };
+}
+
+struct Surfaces
+{
+	TiledSurface Color;
+	TiledSurface Depth;
+
+	void Create()
+	{
+		// The lazy clears of the tiles are taken by the jobs sharing the tiles
+		Color.Create(g_width, g_height);
+		Depth.Create(g_width, g_height);
+		Color.FastClear(0);
+		Depth.FastClear(UINT32_MAX);
+	}
+
+	void Detile(vector<uint32_t>& color, vector<uint32_t>& depth) const
+	{
+		color.resize(g_width * g_height);
+		depth.resize(g_width * g_height);
+		Color.Detile(color.data(), sizeof(uint32_t) * g_width);
+		Depth.Detile(depth.data(), sizeof(uint32_t) * g_width);
+	}
+};
+
+static void renderDraws(vector<uint32_t>* pColors, vector<uint32_t>* pDepths, const RasterSettings& settings)
+{
+	CPURasterizer rasterizer(4);
+	rasterizer.SetViewport(static_cast<float>(g_width), static_cast<float>(g_height));
+	rasterizer.SetSplitThreshold(settings.SplitThreshold);
+	rasterizer.SetTileSize(settings.TileSizeLog, settings.TileToBinLog);
+
+	vector<XMFLOAT4> vertexPos;
+	for (auto i = 0u; i < g_numFrames; ++i)
+	{
+		Surfaces surfaces;
+		surfaces.Create();
+		const auto numTriangles = createScene(vertexPos, i);
+		rasterizer.SetRenderTargets(&surfaces.Color, &surfaces.Depth);
+		rasterizer.SetPixelShader(createPixelShader(i));
+		rasterizer.Draw(vertexPos.data(), numTriangles);
+		surfaces.Detile(pColors[i], pDepths[i]);
+	}
+}
+
+TEST_CASE(CPURasterizerMatchesAcrossTileSizes)
+{
+	vector<uint32_t> refColors[g_numFrames], refDepths[g_numFrames];
+	vector<uint32_t> colors[g_numFrames], depths[g_numFrames];
+	renderDraws(refColors, refDepths, g_settings[0]);
+
+	// The scene covers a part of the screen, but not all of it
+	const auto numCovered = static_cast<size_t>(count_if(refDepths[0].cbegin(), refDepths[0].cend(),
+		[](uint32_t depth) { return depth != UINT32_MAX; }));
+	TEST_CHECK(numCovered > 0 && numCovered < refDepths[0].size());
+
+	for (const auto& settings : g_settings)
+	{
+		renderDraws(colors, depths, settings);
+		for (auto i = 0u; i < g_numFrames; ++i)
+		{
+			TEST_CHECK(colors[i] == refColors[i]);
+			TEST_CHECK(depths[i] == refDepths[i]);
+		}
+	}
+}
+
+TEST_CASE(CPUFramePipelineMatchesDraws)
+{
+	vector<uint32_t> refColors[g_numFrames], refDepths[g_numFrames];
+	vector<uint32_t> colors[g_numFrames], depths[g_numFrames];
+	for (const auto& settings : g_settings)
+	{
+		renderDraws(refColors, refDepths, settings);
+
+		CPUFramePipeline pipeline(2, 3);
+		pipeline.SetViewport(static_cast<float>(g_width), static_cast<float>(g_height));
+		pipeline.SetSplitThreshold(settings.SplitThreshold);
+		TEST_CHECK(pipeline.SetTileSize(settings.TileSizeLog, settings.TileToBinLog));
+
+		// More frames than slots, so that the slots are reused
+		Surfaces surfaces[g_numFrames];
+		for (auto i = 0u; i < g_numFrames; ++i)
+		{
+			surfaces[i].Create();
+			CPUFramePipeline::Frame frame;
+			frame.VS = [i](vector<XMFLOAT4>& vertexPos) { return createScene(vertexPos, i); };
+			frame.PS = createPixelShader(i);
+			frame.pColorTarget = &surfaces[i].Color;
+			frame.pDepth = &surfaces[i].Depth;
+			pipeline.Submit(frame);
+		}
+		pipeline.Flush();
+		TEST_CHECK(pipeline.GetNumCompletedFrames() == g_numFrames);
+
+		for (auto i = 0u; i < g_numFrames; ++i)
+		{
+			surfaces[i].Detile(colors[i], depths[i]);
+			TEST_CHECK(colors[i] == refColors[i]);
+			TEST_CHECK(depths[i] == refDepths[i]);
+		}
+	}
+}
+
+TEST_CASE(FrameGraphRunsIndependentPassesConcurrently)
+{
+	// Each of the two independent passes waits for the other to start, which only
+	// succeeds in time if the workers run them at once. The last pass reads the
+	// outputs of both, so it runs after them.
+	struct
+	{
+		atomic<uint32_t> NumStarted;
+		bool IsOverlapped[2];
+		bool IsJoined;
+	} state;
+	state.NumStarted = 0;
+	state.IsOverlapped[0] = state.IsOverlapped[1] = false;
+	state.IsJoined = false;
+
+	const auto pState = &state;
+	const auto overlap = [pState](uint32_t i)
+	{
+		++pState->NumStarted;
+		const auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+		while (pState->NumStarted < 2 && chrono::steady_clock::now() < deadline) this_thread::yield();
+		pState->IsOverlapped[i] = pState->NumStarted == 2;
+	};
+
+	FrameGraph graph;
+	const auto outputA = graph.ImportResource();
+	const auto outputB = graph.ImportResource();
+	const auto passA = graph.AddPass(L"A", [&overlap](XUSG::CommandList*) { overlap(0); });
+	graph.Write(passA, outputA);
+	const auto passB = graph.AddPass(L"B", [&overlap](XUSG::CommandList*) { overlap(1); });
+	graph.Write(passB, outputB);
+	const auto join = graph.AddPass(L"Join", [pState](XUSG::CommandList*)
+	{
+		pState->IsJoined = pState->IsOverlapped[0] && pState->IsOverlapped[1];
+	});
+	graph.Read(join, outputA);
+	graph.Read(join, outputB);
+
+	graph.Compile();
+	TEST_CHECK(graph.GetNumLevels() == 2);
+	TEST_CHECK(graph.GetPassLevel(passA) == 0 && graph.GetPassLevel(passB) == 0);
+
+	ThreadPool threadPool(2);
+	graph.Execute(threadPool);
+	TEST_CHECK(state.IsOverlapped[0] && state.IsOverlapped[1]);
+	TEST_CHECK(state.IsJoined);
+}
@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+
+using namespace std;
+
+struct TestInfo
+{
+	const char*		Name;
+	Tests::TestFunc	Func;
+};
+
+static atomic<uint64_t> g_numAllocations(0);
+static bool g_isFailed = false;
+
+static vector<TestInfo>& getTests()
+{
+	// Constructed on the first registration, whichever translation unit it is from
+	static vector<TestInfo> tests;
+
+	return tests;
+}
+
+// Replacing the global operator new counts the heap allocations of the whole process,
+// including those of the containers and std::function.
+void* operator new(size_t size)
+{
+	g_numAllocations.fetch_add(1, memory_order_relaxed);
+	const auto p = malloc(size > 0 ? size : 1);
+	if (!p) throw bad_alloc();
+
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+Tests::Registrar::Registrar(const char* name, TestFunc func)
+{
+	getTests().push_back({ name, func });
+}
+
+void Tests::ReportFailure(const char* file, int line, const char* expression)
+{
+	cout << file << "(" << line << "): check failed: " << expression << endl;
+	g_isFailed = true;
+}
+
+uint64_t Tests::GetNumAllocations()
+{
+	return g_numAllocations.load(memory_order_relaxed);
+}
+
+int main(int argc, char* argv[])
+{
+	const auto filter = argc > 1 ? argv[1] : "";
+
+	auto numRun = 0u;
+	auto numFailed = 0u;
+	for (const auto& test : getTests())
+	{
+		if (!strstr(test.Name, filter)) continue;
+
+		cout << "[ RUN    ] " << test.Name << endl;
+		g_isFailed = false;
+		test.Func();
+		cout << (g_isFailed ? "[ FAILED ] " : "[     OK ] ") << test.Name << endl;
+		numFailed += g_isFailed ? 1 : 0;
+		++numRun;
+	}
+
+	cout << numRun - numFailed << " of " << numRun << " tests passed" << endl;
+
+	return numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+//--------------------------------------------------------------------------------------
+// Minimal test harness. The test cases register themselves before main(), which runs
+// all of them, or only those whose names contain the command-line argument, and
+// returns nonzero if any check has failed.
+//--------------------------------------------------------------------------------------
+namespace Tests
+{
+	using TestFunc = void(*)();
+
+	struct Registrar
+	{
+		Registrar(const char* name, TestFunc func);
+	};
+
+	void ReportFailure(const char* file, int line, const char* expression);
+
+	// Calls of the global operator new by all threads since the start of the process
+	uint64_t GetNumAllocations();
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static Tests::Registrar g_##name##Registrar(#name, name); \
+	static void name()
+
+// Fails the test case and returns from it
+#define TEST_CHECK(expression) \
+	do { if (!(expression)) { Tests::ReportFailure(__FILE__, __LINE__, #expression); return; } } while (false)
@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently.
+// Unlike that of ComputeRaster, it defines no debug new, so that the replaced
+// operator new of Main.cpp sees every allocation.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers.
+#endif
+
+#define DLL_INTERFACE __declspec(dllimport)
+
+#include <windows.h>
+
+#include <dxgi1_4.h>
+#include <DirectXMath.h>
+#include "d3dx12.h"
+
+// C RunTime Header Files
+#include <iostream>
+#include <atomic>
+#include <cstring>
+#include <random>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <wrl.h>